@@ -1,549 +1,4644 @@
-/*************************************************************************************************************************
- * 
- * NAME
- *    adventure.c - the game program
- * SYNOPSIS
- *    When compiled and run, uses the most recently created files from the room-building program to present an interface
- *       to the player and run the game.
- *    In the game, the player will begin in the "starting room" and will win the game automatically upon entering the
- *       "ending room", which causes the game to exit, displaying the path taken by the player.
- * INSTRUCTIONS
- *    Compile the program using this line:
- *       gcc -o adventure adventure.c -lpthread
- *    Run the game program by executing:
- *       adventure
- * DESCRIPTION
- *    When compiled and run, performs a stat() function call on the rooms directory in the same directory of the game,
- *       and opens the one with the most recent st_mtime component of the returned stat struct.
- *    Then presents the player with an interface that:
- *       > Lists where the player currently is.
- *       > Lists the possible connections that can followed.
- *       > A prompt to the user.
- *    If the user types the exact name of a connection to another room and then hits return, the program writes a new
- *       line and then continues running as before but with the new room that the player entered.
- *    If the user types anything but a valid room name (case sensitive), the game returns an error line and repeats
- *       the current location and prompt.
- *          > Trying to go to an incorrect location does not increment the path history or the step count.
- *    Once the user has reached the "ending room", the game indicates that it has been reached, prints the path the
- *       user has taken to get there, the number of steps taken, a congratulatory message, and then exists with a
- *       status code of 0.
- *    While the game is running, if the player types the command "time" at the prompt and hits enter, utilizing a
- *       second thread and mutex(es), the game writes the current time of day to a file called "currentTime.txt"
- *       in the same directory as the game, and then reads this line and prints it out to the user.
- *          > Using the time command does not increment the path history or step count.
- * AUTHOR
- *    Written by Andrew Swaim
- *
-*************************************************************************************************************************/
-
-#include <pthread.h>
-#include <unistd.h>
-#include <sys/types.h>
-#include <sys/stat.h>
-#include <fcntl.h>
-#include <dirent.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <time.h>
-
-#define NUM_OF_ROOMS 7      // Constant to hold the number of rooms that will be created.
-#define NUM_OF_NAMES 10     // Constant to hold the total number of room names.
-#define MAX_CONNECTIONS 6   // Maximum number of connections a room can have.
-#define MAX_CHARS 8         // Maximum number of characters for each name.
-#define STR_BUFFER 100      // General purpose buffer for string handling.
-
-// Create bool type for C89/C90 compilation.
-typedef enum { false, true } bool;
-
-// Room type enum and string array for conversion.
-enum Types { START_ROOM, MID_ROOM, END_ROOM };
-char* types[] = {"START_ROOM"
-                , "MID_ROOM"
-                , "END_ROOM"};
-
-// Room struct.
-struct Room
-{
-    char name[MAX_CHARS+1];
-    enum Types type;
-    int numConnections;
-    char connections[MAX_CONNECTIONS][MAX_CHARS+1];
-};
-
-/*************************************************************************************************************************
- * Function Declarations
-*************************************************************************************************************************/
-
-int InitRooms(struct Room rooms[]);
-//char* GetMostRecentDir();
-void GetMostRecentDir(char dirName[]);
-void DisplayRoom(struct Room* room);
-int GetSelectedRoomIndex(struct Room rooms[], struct Room* room, char* roomName);
-void RecordValidChoice(char* roomName, char* filename);
-void PrintPlayerPath(char* filename);
-void* WriteTime(void* mutex);
-void DisplayTime();
-
-/*************************************************************************************************************************
- * Main 
-*************************************************************************************************************************/
-
-int main()
-{
-    // Struct array to hold the information for the rooms.
-    struct Room rooms[NUM_OF_ROOMS];
-
-    // Variables to keep track of the current room.
-    int currentRoomIndex = -1;
-    struct Room* currentRoom;
-
-    // Variables to get the user choice.
-    char* userChoice = NULL;
-    size_t userChoiceBuffer = 0;
-
-    // Variables to keep track of player stats such as steps and path taken.
-    int steps = 0;
-    FILE* file;
-    char tmpFilename[STR_BUFFER];
-    char* tmpFilePrefix = "tmpfile.";
-    int pid;
-    
-    // Mutex variable for handling multithreading.
-    pthread_mutex_t myMutex = PTHREAD_MUTEX_INITIALIZER;
-
-    // Lock the mutex and spawn a second thread.
-    pthread_mutex_lock(&myMutex);
-    pthread_t thread;
-    if ((pthread_create(&thread, NULL, WriteTime, (void*) &myMutex)) != 0)
-    {
-        printf("ERROR: There was a problem creating a second thread\n");
-        perror("In main() with pthread_create()");
-        exit(1);
-    }
-
-    // Get the starting room.
-    currentRoomIndex = InitRooms(rooms);
-    if (currentRoomIndex < 0 || currentRoomIndex > 6)
-    {
-        // Error handling.
-        printf("ERROR: There was a problem getting the starting room, exiting...\n");
-        perror("In main() with GetStartingRoomIndex()");
-        exit(1);
-    } 
-    else
-    {
-        currentRoom = &rooms[currentRoomIndex];
-    }
-
-    // Create the temp filename to store the user path.
-    pid = getpid();
-    memset(tmpFilename, '\0', STR_BUFFER);
-    snprintf(tmpFilename, sizeof(tmpFilename), "%s%d", tmpFilePrefix, pid);
-
-    // Create the temp file and truncate it if it already exists.
-    if ((file = fopen(tmpFilename, "w")) == NULL)
-    {
-        printf("ERROR: Failed to open filename \"%s\"\n", tmpFilename);
-        perror("In main()");
-        exit(1);
-    }
-    fclose(file);
-
-    // Start the game.
-    while ((strcmp(types[currentRoom->type], "END_ROOM")) != 0)
-    {
-        // Check if the mutex is already locked by the main thread.
-        if ((pthread_mutex_trylock(&myMutex)) == 0)
-        {
-            // If the (re)lock by the main thread is succesful, create a new thread.
-            if ((pthread_create(&thread, NULL, WriteTime, (void*) &myMutex)) != 0)
-            {
-                printf("ERROR: There was a problem creating a second thread\n");
-                perror("In main() with pthread_create()");
-                exit(1);
-            }
-        }
-
-        // Display the current room.
-        DisplayRoom(currentRoom);
-
-        // Prompt the user, get the input and remove the newline character.
-        printf("WHERE TO? >");
-        getline(&userChoice, &userChoiceBuffer, stdin);
-        userChoice[strcspn(userChoice, "\n")] = '\0';
-        
-        // Process user choice.
-        if (strcmp(userChoice, "time") == 0)
-        {
-            // If the user typed "time", unlock the mutex to allow WriteTime to execute in the second thread.
-            pthread_mutex_unlock(&myMutex);
-
-            // Wait for the second thread to finish.
-            pthread_join(thread, NULL);
-
-            // Display the time that was written by the second thread.
-            DisplayTime();
-        }
-        else
-        {
-            // Otherwise, try to get the user choice.
-            currentRoomIndex = GetSelectedRoomIndex(rooms, currentRoom, userChoice);
-            if (currentRoomIndex == -1)
-            {
-                // If the user choice was invalid, display an error message, don't increment the steps, and loop again.
-                printf("\nHUH? I DON'T UNDERSTAND THAT ROOM. TRY AGAIN\n\n");
-            }
-            else if (currentRoomIndex > 6 || currentRoomIndex < -1)
-            {
-                // Error handling.
-                printf("ERROR: Something went wrong trying to get the selected room index %d\n", currentRoomIndex);
-                perror("In main() with GetSelectedRoomIndex()");
-                exit(1);
-            }
-            else
-            {
-                // Otherwise, if the user choice was valid, get the selected room, record the valid user choice
-                // and increment the step count
-                currentRoom = &rooms[currentRoomIndex];
-                RecordValidChoice(userChoice, tmpFilename);
-                steps++;
-                printf("\n"); // To match the formatting of the example.
-            }
-        }
-    // Deallocate memory for user choice.
-    free(userChoice);
-    userChoice = NULL;
-    } // End of game loop.
-
-    // If the loop was exited then the player has reached the end room and the game is over.
-    // Print a congratulatory message, the number of steps the player took, and the path the player took. 
-    printf("YOU HAVE FOUND THE END ROOM. CONGRATULATIONS!");
-    printf("\nYOU TOOK %d STEPS. YOUR PATH TO VICTORY WAS:\n", steps);
-    PrintPlayerPath(tmpFilename);
-
-    // Delete the temp file.
-    remove(tmpFilename);
-
-    // Destroy the mutex.
-    pthread_mutex_destroy(&myMutex);
-
-    return 0;
-}
-
-/*************************************************************************************************************************
- * Function Definitions 
-*************************************************************************************************************************/
-
-/* Initializes the rooms using the room files from the build-rooms program, and returns the index of the "starting room".
-   Returns -1 if there was an error initializing or getting the starting room. */
-int InitRooms(struct Room rooms[])
-{
-    // Variable to capture whichever room is the start room.
-    int startingIndex = -1;
-
-    // Variables for navigating the rooms directory.
-    DIR* dir;
-    char dirName[STR_BUFFER];
-    struct dirent* dirEntry;
-
-    // Variables to store the names of, and navigate, the files in the room files.
-    char filenames[NUM_OF_ROOMS][STR_BUFFER];
-    FILE* file;
-    char fileLine[STR_BUFFER];
-    char* word;
-
-    // Get the most recently created rooms directory.
-    memset(dirName, '\0', STR_BUFFER);
-    GetMostRecentDir(dirName);
-
-    // Open the directory.
-    dir = opendir(dirName);
-
-    // Loop through all the files in the opened rooms directory and get the filenames.
-    int i = 0;
-    while ((dirEntry = readdir(dir)) != NULL)
-    {
-        // If the file is a regular file (not a directory).
-        if (dirEntry->d_type == DT_REG)
-        {
-            // Capture the full filepath of the file ("rooms.PID/room-name_room")
-            memset(filenames[i], '\0', STR_BUFFER);
-            snprintf(filenames[i], sizeof(filenames[i]), "%s/%s", dirName, dirEntry->d_name);
-            i++;
-        }
-    }
-    closedir(dir);
-
-    // Open all the files and put the contents in rooms[].
-    int j;
-    for (i = 0; i < NUM_OF_ROOMS; i++)
-    {
-        // Open the file for reading.
-        if ((file = fopen(filenames[i], "r")) == NULL)
-        {
-            printf("ERROR: Failed to open filename \"%s\"\n", filenames[i]);
-            perror("In InitRooms()");
-            exit(1);
-        }
-        
-        // Get the first line from the file.
-        memset(fileLine, '\0', STR_BUFFER);
-        fgets(fileLine, sizeof(fileLine), file);
-
-        // Remove the trailing newline character.
-        fileLine[strcspn(fileLine, "\n")] = '\0';
-
-        // Get the last word from the line and assign it as the room name.
-        word = strrchr(fileLine, ' ') + 1;
-        strcpy(rooms[i].name, word);
-
-        // Get the first CONNECTION line, minus the newline character.
-        memset(fileLine, '\0', STR_BUFFER);
-        fgets(fileLine, sizeof(fileLine), file);
-        fileLine[strcspn(fileLine, "\n")] = '\0';
-
-        // Loop through the CONNECTION lines.
-        j = 0;
-        rooms[i].numConnections = 0; // Initialize the number of connections of the room.
-        while (fileLine[0] == 'C') // The lines should be only ones in the file that start with 'C'.
-        {
-            // Get last word of each line (the connection names).
-            word = strrchr(fileLine, ' ') + 1;
-            strcpy(rooms[i].connections[j], word);
-
-            // Increment the number of connections for the room.
-            rooms[i].numConnections++;
-
-            // Prepare for next loop;
-            j++;
-            memset(fileLine, '\0', STR_BUFFER);
-            fgets(fileLine, sizeof(fileLine), file);
-            fileLine[strcspn(fileLine, "\n")] = '\0';
-        }
-
-        // The last fgets should have been called already for the room type, so simply get the last word.
-        word = strrchr(fileLine, ' ') + 1;
-
-        // Assign the room type and capture the START_ROOM index to return and start the game.
-        if ((strcmp(word, "START_ROOM")) == 0)
-        {
-            rooms[i].type = START_ROOM;
-            startingIndex = i;
-        }
-        else if ((strcmp(word, "MID_ROOM")) == 0)
-        {
-            rooms[i].type = MID_ROOM;
-        }
-        else if ((strcmp(word, "END_ROOM")) == 0)
-        {
-            rooms[i].type = END_ROOM;
-        }
-
-        // Close the file and loop again to read from the next file.
-        fclose(file);
-    }
-
-    return startingIndex;
-}
-
-// Returns the name of the most recently created directory.
-void GetMostRecentDir(char dirName[])
-{
-    // Directory variables.
-    DIR* dir;
-    int statRet = 0;
-    struct stat dirStat;
-    struct dirent* dirEntry;
-    time_t mostRecentTime = 0;
-
-    // Open the current directory.
-    dir = opendir(".");
-
-    // Loop through all the files in the current directory.
-    while ((dirEntry = readdir(dir)) != NULL)
-    {
-        // (Re)Initialize stat buffer.
-        memset(&dirStat, 0, sizeof(dirStat));
-
-        // Get stats of current directory entry.
-        statRet = stat(dirEntry->d_name, &dirStat);
-
-        // Error handling.
-        if (statRet != 0)
-        {
-            printf("ERROR: There was an error getting the stats of directory %s\n", dirEntry->d_name);
-            perror("In GetMostRecentDir() with stat()");
-            exit(1);
-        } // If the file path type is a directory that starts with "rooms.".
-        else if (S_ISDIR(dirStat.st_mode) && (strstr(dirEntry->d_name, "rooms.") != NULL))
-        {
-            // Compare its modified time value to find the most recent time.
-            if (dirStat.st_mtime > mostRecentTime)
-            {
-                // Get the directory name and update the modified time comparison variable.
-                memset(dirName, '\0', STR_BUFFER);
-                strcpy(dirName, dirEntry->d_name);
-                mostRecentTime = dirStat.st_mtime;
-            }
-        } // If the file path was not a rooms directory, simply loop again to the next file.
-    }
-
-    if ((strlen(dirName)) == 0)
-    {
-        printf("ERROR: There is no rooms directory in the current directory.\n");
-        perror("In GetMostRecentDir()");
-        exit(1);
-    }
-
-    // Close the directory.
-    closedir(dir);
-    
-    //return dirName;
-}
-
-
-// Takes a pointer to a room and displays the details of the room.
-void DisplayRoom(struct Room* room)
-{
-    printf("CURRENT ROOM: %s\n", room->name);
-    printf("POSSIBLE CONNECTIONS: ");
-    int i;
-    int numConnections = room->numConnections;
-    for(i = 0; i < numConnections-1; i++)
-    {
-        printf("%s, ", room->connections[i]);
-    }
-    printf("%s.\n", room->connections[i]);
-}
-
-// Checks if the user choice was a valid connection for the current room, and if so gets the new room index.
-int GetSelectedRoomIndex(struct Room rooms[], struct Room* currentRoom, char* roomName)
-{
-    // Check if the user choice is valid.
-    int i;
-    int numConnections = currentRoom->numConnections;
-    for (i = 0; i < numConnections; i++)
-    {
-        if ((strcmp(currentRoom->connections[i], roomName)) == 0)
-        {
-            break;
-        }
-    }
-
-    // If the loop did not exit early, then the user choice was not a valid connection so return -1;
-    if (i == numConnections)
-    {
-        return -1;
-    }
-
-    // If it did exit early, get the index of the user choice.
-    for (i = 0; i < NUM_OF_ROOMS; i++)
-    {
-        if ((strcmp(rooms[i].name, roomName)) == 0)
-        {
-            return i;
-        }
-    }
-
-    // If this point is reached, something went wrong.
-    return -5;
-}
-
-// Takes the name of a valid room choice made by the user and writes it to the temp file.
-void RecordValidChoice(char* roomName, char* filename)
-{
-    FILE* file;
-
-    // Open the temp file for appending.
-    if ((file = fopen(filename, "a")) == NULL)
-    {
-        printf("ERROR: Failed to open filename \"%s\"\n", filename);
-        perror("In RecordValidChoice()");
-        exit(1);
-    }
-
-    // Put the room name in the file with a newline character
-    fputs(roomName, file);
-    fputs("\n", file);
-
-    // Close temp file.
-    fclose(file);
-}
-
-// Takes the name of temp file and prints the recorded player path to the screen.
-void PrintPlayerPath(char* filename)
-{
-    FILE* file;
-    char fileLine[MAX_CHARS+2]; // +2 to take into account the newline and null characters
-
-    // Open the temp file for reading.
-    if ((file = fopen(filename, "r")) == NULL)
-    {
-        printf("ERROR: Failed to open filename \"%s\"\n", filename);
-        perror("In PrintPlayerPath()");
-        exit(1);
-    }
-
-    // Get the lines from the temp file and print them to the screen.
-    memset(fileLine, '\0', MAX_CHARS+2);
-    while ((fgets(fileLine, sizeof(fileLine), file)) != NULL)
-    {
-        printf("%s", fileLine);
-        memset(fileLine, '\0', MAX_CHARS+2);
-    }
-
-    fclose(file);
-}
-
-// Runs concurrently with main() but is immediately locked, and only unlocks when the user types "time".
-void* WriteTime(void* myMutex)
-{
-    // Lock this second thread until unlock is called in main().
-    pthread_mutex_lock(myMutex);
-
-    // Once unlocked, get current time.
-    time_t calendar_tm = time(NULL);
-    struct tm* local_tm = localtime(&calendar_tm);
-
-    // Get the formated string.
-    char strTime[STR_BUFFER];
-    memset(strTime, '\0', STR_BUFFER);
-    strftime(strTime, STR_BUFFER, "%l:%M%P, %A, %B %d, %Y", local_tm);
-
-    // Add the formated sring to a file called "currentTime.txt", and truncate if the file already exists.
-    FILE* file;
-    if ((file = fopen("currentTime.txt", "w")) == NULL)
-    {
-        printf("ERROR: Failed to open filename \"currentTime.txt\"\n");
-        perror("In WriteTime()");
-        exit(1);
-    }
-    fputs(strTime, file);
-    fclose(file);
-
-    // Unlock the mutex so that the main thread can lock it again.
-    pthread_mutex_unlock(myMutex);
-}
-
-// Displays the current time recorded in "currentTime.txt".
-void DisplayTime()
-{
-    // Open the file "currentTime.txt".
-    FILE* file;
-    if ((file = fopen("currentTime.txt", "r")) == NULL)
-    {
-        printf("ERROR: Failed to open filename \"currentTime.txt\"\n");
-        perror("In DisplayTime()");
-        exit(1);
-    }
-    
-    // Print the time that was recorded in the file.
-    char strTime[STR_BUFFER];
-    memset(strTime, '\0', STR_BUFFER);
-    fgets(strTime, sizeof(strTime), file);
-    printf("\n%s\n\n", strTime);
-
-    // Close the file.
-    fclose(file);
-}
+/*************************************************************************************************************************
+ * 
+ * NAME
+ *    adventure.c - the game program
+ * SYNOPSIS
+ *    When compiled and run, uses the most recently created files from the room-building program to present an interface
+ *       to the player and run the game.
+ *    In the game, the player will begin in the "starting room" and will win the game automatically upon entering the
+ *       "ending room", which causes the game to exit, displaying the path taken by the player.
+ * INSTRUCTIONS
+ *    Compile the program using this line:
+ *       gcc -o adventure adventure.c world.c bench.c -lpthread
+ *    Run the game program by executing:
+ *       adventure [-P | -H] [-L cache-kb] [-s spill-limit] [-t] [-R record-file] [-C checkpoint-file]
+ *    Or run scripted games without prompts by executing:
+ *       adventure [-P | -H] [-L cache-kb] [-s spill-limit] [-t] -r script...
+ *    Or host games for many players over a Unix domain socket by executing:
+ *       adventure [-P | -H] [-s spill-limit] [-t] -S socket-path [-j workers]
+ *    Or check generated worlds without playing by executing:
+ *       adventure -V [-j threads] [-m min-connections] [-M max-connections] [path...]
+ *    Any of these can be timed by adding -T timing-file, or by setting ADVENTURE_TIMING=timing-file.
+ *    Games (but not -V or -B) can keep live counters for advstats by adding -E stats-dir, or by setting
+ *       ADVENTURE_STATS=stats-dir.
+ * DESCRIPTION
+ *    When compiled and run, opens the world that the rooms.latest link (kept up to date by buildrooms) in the same
+ *       directory of the game points to. If there is no such link, or it points to a missing world, performs a stat()
+ *       function call on the rooms directories in the same directory of the game, and opens the one with the most
+ *       recent st_mtime component of the returned stat struct. Entries that cannot be stat()ed are skipped.
+ *    With -P, the game instead claims a world of its own from the pool directory that buildrooms -P keeps full, by
+ *       renaming a ready world to claimed.PID: only one game can rename a world, so games started together always get
+ *       different worlds, and startup never waits for a world to be generated. The claimed world is removed when the
+ *       program exits. If the pool is empty, the newest world is played as without -P.
+ *    If the rooms directory holds a binary world file (world.bin, written by buildrooms -f binary), the file is
+ *       mapped into memory with mmap() and used as is after checking its header and checksum. Otherwise the room
+ *       files are read and converted into the same in-memory layout, the world image shared with buildrooms through
+ *       world.h: connections as compressed sparse row (CSR) arrays of room indexes, room types packed one byte per
+ *       room, and the names in a string pool, so a move only touches the few cache lines it needs.
+ *          > The room files are opened, read and closed through io_uring (raw system calls, no liburing), with up
+ *            to 64 files in flight, and each file is parsed as soon as its read completes. Without io_uring (before
+ *            Linux 5.7, or disabled), a pool of threads (one per core, up to 8) reads the files with one read() each.
+ *          > The text of each file goes onto the end of one buffer holding the text of every room file, and its lines
+ *            are split with memchr(). Names are kept as slices of that text, and only copied once, into the world's
+ *            string pool. The rooms keep the order of the filenames however the reads complete. The lines ROOM
+ *            NAME, CONNECTION <number> and ROOM TYPE may come in any order, and a malformed file (a missing or
+ *            repeated key, an unknown key or room type, or a name that is empty, holds spaces or is over 255
+ *            characters) is reported with its file and line.
+ *    With -L, the rooms are loaded on demand instead: the game starts from the START_ROOM named in the manifest file
+ *       written by buildrooms (or, without one, reads room files until it finds it), and each other room is read
+ *       from its file, named after the room, when it is first entered or listed. Loaded rooms are kept in a cache of
+ *       at most cache-kb kilobytes, evicting the least recently used first, and only the names of the rooms seen so
+ *       far are kept beyond it. Hints and the shortest path need every room, so they are not available, unless the
+ *       world has a binary world file, which is mapped whole as without -L.
+ *    Once loaded, a hash index from room names to room indexes is built, so checking and executing a move takes a
+ *       constant number of operations no matter how many rooms the world has.
+ *    A distance oracle is also built: one breadth-first search back from the "ending room" along the connections
+ *       turned around (so rooms that do not connect back are handled), with its frontiers kept as bitsets, gives every
+ *       room its distance to the end and the connection that leads one step closer. The command "hint" names that
+ *       connection, and the end of game message compares the steps taken with the shortest path, both without any
+ *       search while playing.
+ *    With -H, the loaded world, its name index and distance oracle are shared by every game started with -H: the
+ *       first game copies them into a POSIX shared memory segment named after the world's path, and the others map
+ *       it read-only, which takes microseconds and no memory of their own. The segment only holds offsets, records
+ *       the world it was loaded from, a generation number and the number of attached games, and is replaced when a
+ *       new world takes the path. The last game to exit removes it. Not with -L or -P.
+ *    Then presents the player with an interface that:
+ *       > Lists where the player currently is.
+ *       > Lists the possible connections that can followed.
+ *       > A prompt to the user.
+ *    If the user types the exact name of a connection to another room and then hits return, the program writes a new
+ *       line and then continues running as before but with the new room that the player entered.
+ *    If the user types anything but a valid room name (case sensitive), the game returns an error line and repeats
+ *       the current location and prompt.
+ *          > Trying to go to an incorrect location does not increment the path history or the step count.
+ *    Once the user has reached the "ending room", the game indicates that it has been reached, prints the path the
+ *       user has taken to get there, the number of steps taken, a congratulatory message, and then exists with a
+ *       status code of 0.
+ *          > The path is kept in memory as an array of room indexes and printed with a single write. With -s, all but
+ *            the last spill-limit rooms of a very long path are moved to an anonymous temporary file as raw indexes.
+ *    While the game is running, if the player types the command "time" at the prompt and hits enter, the game
+ *       prints out the current time of day to the user.
+ *          > The time is formatted by a long-lived second thread, which the main thread talks to through a mutex and
+ *            condition variables. The thread keeps the formatted time cached and refreshes it every minute, so most
+ *            requests are answered straight from the cache.
+ *          > With -t, the second thread also writes the time to a file called "currentTime.txt" in the same
+ *            directory as the game each time it is requested.
+ *          > Using the time command does not increment the path history or step count.
+ *    With -C, the game is saved to a small binary checkpoint file after every move, and resumed from it when the game
+ *       is started again with the same file, so a game that crashed or was stopped goes on from its last move.
+ *          > The checkpoint is a header holding the checksum of the world image (a game only resumes the world it
+ *            was saved from), written to a temporary file, flushed and renamed into place with the rename flushed
+ *            too. Each move then appends its room, as a varint of its zigzag encoded difference from the room
+ *            before it, and 4 bytes of a checksum chained through every move, and flushes it with fdatasync(): a
+ *            save costs a few bytes however long the path is, and survives a power loss once the move is shown.
+ *          > Resuming decodes the path without playing any move again, up to the first move whose chain does not
+ *            match (one cut short by a crash), which is cut off. A finished game removes its checkpoint. Not with
+ *            -L, -r or -S.
+ *    With -R, every line the user types is also recorded to a file, which can later be replayed with -r.
+ *    With -r, the game runs headless: each script (one command per line, as typed at the prompt) is played against
+ *       the world from the starting room with no prompts, and one tab-separated line is printed per script with its
+ *       outcome (WON or UNFINISHED), steps, shortest path, commands, invalid rooms and run time in microseconds, followed by a
+ *       summary. Exits with a status code of 0 if every script reached the "ending room", and 1 otherwise.
+ *    The command "path" prints the path taken so far (and, like "time", does not count as a step).
+ *    The command "hint" names the connection that is one step closer to the "ending room" (and does not count as a
+ *       step either).
+ *    With -S, the game runs as a server: the world is loaded once and shared read-only by every player connecting to
+ *       the socket (e.g. with "nc -U socket-path"), each of whom plays their own game exactly as they would at the
+ *       prompt. A poll() loop watches the connections, and a fixed pool of worker threads (-j, 4 by default) runs
+ *       the commands. Each worker has its own queue and steals from the other queues when it runs out of work.
+ *       Connections are non-blocking, and output a player has not read yet is queued (up to 64 KB) and sent when
+ *       poll() finds the connection writable. A player's input is not read while their queue is full, and a worker
+ *       runs at most 64 commands of one player before handing them back, so no player can hold up the others.
+ *       A player only holds a current room, a step count and a path. Stop the server with SIGINT or SIGTERM.
+ *    With -V, the game checks worlds instead: every rooms.* directory found in the paths (the current directory by
+ *       default, searched recursively) is loaded and checked across -j threads (one per core by default) for rooms
+ *       with fewer than -m or more than -M connections (3 and 6 by default), connections that do not connect back,
+ *       connections to the room itself or repeated connections, anything but exactly one START_ROOM and one END_ROOM,
+ *       and an END_ROOM that cannot be reached from the START_ROOM. Every problem is reported (up to 10 per world)
+ *       along with files that cannot be read, and the exit status is 0 only if every world is valid.
+ *    With -T (or the ADVENTURE_TIMING environment variable), finding and loading the world, loading rooms on demand,
+ *       building the distance oracle, checking each world, each command by its result, the time requests and
+ *       updates, printing the path, writing the output, and saving and resuming checkpoints are timed with the
+ *       monotonic clock. The times go into histograms with 4 buckets per power of two nanoseconds, updated with
+ *       atomic operations so any thread can record. On exit, the count, p50, p99, max and total of each are printed
+ *       as a table on stderr and written as JSON to the timing file ("-" for stderr). Timing costs a single flag test
+ *       when it is off.
+ *    With -E (or the ADVENTURE_STATS environment variable), the game keeps live counters of commands by their result,
+ *       games, wins and server clients, and the time the world took to load, in a file adventure.PID.stats of the
+ *       statistics directory mapped into memory (see stats.h). Each thread counts into a cache-line aligned block of
+ *       its own with plain stores, so counting takes no lock and no system call, and advstats reads and adds up the
+ *       counters of every running game without stopping them. The file is removed when the program exits.
+ * AUTHOR
+ *    Written by Andrew Swaim
+ *
+*************************************************************************************************************************/
+
+#define _GNU_SOURCE             // For open file description locks (F_OFD_SETLK).
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <linux/io_uring.h>
+#include "world.h"
+#include "bench.h"
+#include "stats.h"
+
+#define MAX_NAME_LENGTH 255 // Longest room name accepted in a room file.
+#define MAX_ROOM_FILE 65536 // Largest room file that is read.
+#define READ_QUEUE_DEPTH 64 // Room files read at the same time through io_uring.
+#define ROOM_READ_SIZE 4096 // First read of a room file through io_uring, larger files are read in growing chunks.
+#define MAX_READERS 8       // Most threads reading room files when io_uring is not available.
+#define STR_BUFFER 100      // General purpose buffer for string handling.
+#define PATH_CAPACITY 64    // Initial number of rooms the path history has space for.
+#define NUM_OF_WORKERS 4    // Default number of worker threads in server mode.
+#define COMMAND_BUFFER 256  // Longest command a player connected to the server can type.
+#define MAX_CLIENT_OUTPUT 65536 // Unsent output a player may have queued before the server stops reading their input.
+#define TASK_COMMANDS 64    // Most commands of a player a worker runs before handing the player back to poll().
+#define ERROR_BUFFER 512    // Buffer for the description of a world that cannot be loaded.
+#define MAX_REPORTS 10      // Problems the validator prints per world, any others are only counted.
+#define MIN_CONNECTIONS 3   // Default minimum number of connections the validator expects a room to have.
+#define MAX_CONNECTIONS 6   // Default maximum number of connections the validator expects a room to have.
+#define NUM_OF_BUCKETS 256  // Buckets of a timing histogram, enough for any time in nanoseconds, see GetBucket().
+#define MOVE_QUERIES 4096   // Moves checked per timed operation of the move benchmark.
+#define UNREACHABLE UINT32_MAX      // Distance of a room that has no path to the "ending room".
+#define UNKNOWN_TYPE 0xFF           // Type of a room that is only known by name, until its room file is loaded.
+#define MANIFEST_FILENAME "manifest"    // Names the START_ROOM of a world of room files, must match buildrooms.c.
+#define SHARED_PREFIX "/adventure-world-"   // Shared memory segments of worlds, named by a hash of the world's path.
+#define SHARED_MAGIC "ADVSHARE"     // Identifies a shared world segment (8 characters, no null character stored).
+#define SHARED_VERSION 1            // Bumped whenever the layout of a shared world segment changes.
+#define SHARED_ALIGN 64             // Every part of a shared world segment starts on its own cache line.
+#define PUBLISH_LOCK 0              // Byte of a shared world segment locked to publish, attach to or remove it.
+#define PLAYER_LOCK 1               // Byte of a shared world segment every attached game holds a read lock on.
+#define CHECKPOINT_MAGIC "ADVCHKPT" // Identifies a checkpoint file (8 characters, no null character stored).
+#define CHECKPOINT_VERSION 2        // Bumped whenever the layout of a checkpoint file changes.
+
+// Slice struct, a name inside the text read from the room files, which is only copied into the world image.
+struct Slice
+{
+    size_t offset;                  // Offset of the name in the text (the text can move as it grows).
+    size_t length;
+};
+
+// Room struct, used while reading the room files.
+struct Room
+{
+    struct Slice name;
+    enum Types type;
+    int numConnections;
+    int firstConnection;            // Index of the room's first entry in the array of connection names.
+};
+
+// World struct, a read-only world image (mapped from world.bin or built from the room files) and its indexes.
+struct World
+{
+    struct WorldImage image;
+    bool mapped;                    // True if the image was mapped with mmap(), false if it was allocated.
+    uint32_t* nameIndex;            // Hash table of room index + 1 (0 marks an empty slot), see BuildNameIndex().
+    uint32_t nameIndexMask;         // Number of slots in the name index minus one (the number of slots is a power of 2).
+    uint32_t* distances;            // Steps from each room to the "ending room", or UNREACHABLE.
+    uint32_t* nextHops;             // Connection of each room that is one step closer to the "ending room".
+    struct RoomCache* cache;        // Loads the rooms on demand, NULL if every room was loaded up front.
+    bool shared;                    // True if the image and indexes are in a shared segment, see OpenSharedWorld().
+};
+
+/* SharedWorldHeader struct, the start of a shared memory segment holding a loaded world and its indexes for every game
+   started with -H. Everything is found by its offset from the start of the segment, so the segment works at whatever
+   address each process maps it, and only the header is ever mapped writable. */
+struct SharedWorldHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t ready;                 // Set once the segment is filled in, a segment left unready by a crash is refilled.
+    uint64_t generation;            // Worlds published under this segment name so far, this one included.
+    uint64_t refCount;              // Games attached to the segment, updated with atomic operations.
+    uint64_t worldDev;              // Identity of the rooms directory the world was loaded from, to spot a new world
+    uint64_t worldIno;              //    that replaced it under the same path.
+    int64_t worldMtime;             // In nanoseconds.
+    uint64_t imageOffset;
+    uint64_t nameIndexOffset;
+    uint64_t distancesOffset;
+    uint64_t nextHopsOffset;
+    uint64_t size;                  // Size of the whole segment.
+    uint32_t nameIndexMask;
+};
+
+// Path struct, the indexes of the rooms the player has entered, in order.
+struct Path
+{
+    uint32_t* rooms;                // Rooms held in memory, which follow any spilled rooms.
+    size_t numRooms;
+    size_t capacity;
+    size_t spillLimit;              // Rooms held in memory before they are spilled to disk, 0 to never spill.
+    FILE* spillFile;                // Anonymous temporary file of spilled room indexes, NULL until the first spill.
+    size_t numSpilled;
+};
+
+// Session struct, the state of one game.
+struct Session
+{
+    int currentRoom;
+    int steps;
+    struct Path path;
+};
+
+// Results of processing one command.
+enum Results { ROOM_ENTERED, ROOM_INVALID, TIME_SHOWN, PATH_SHOWN, HINT_SHOWN };
+
+// Metrics that are timed with -T, and their names in the timing dump.
+enum Metrics { FIND_WORLD, LOAD_WORLD, LOAD_ROOM, BUILD_ORACLE, VALIDATE_WORLD, MOVE_COMMAND, INVALID_COMMAND,
+               TIME_COMMAND, PATH_COMMAND, HINT_COMMAND, TIME_REQUEST, TIME_UPDATE, PRINT_PATH, WRITE_OUTPUT,
+               SAVE_CHECKPOINT, RESUME_GAME, NUM_OF_METRICS };
+char* metricNames[] = {"find_world"
+                      , "load_world"
+                      , "load_room"
+                      , "build_oracle"
+                      , "validate_world"
+                      , "move"
+                      , "invalid"
+                      , "time"
+                      , "path"
+                      , "hint"
+                      , "time_request"
+                      , "time_update"
+                      , "print_path"
+                      , "write_output"
+                      , "checkpoint"
+                      , "resume"};
+
+// Metric of the command that gave each result.
+enum Metrics commandMetrics[] = { MOVE_COMMAND, INVALID_COMMAND, TIME_COMMAND, PATH_COMMAND, HINT_COMMAND };
+
+// Counters kept live in the statistics file with -E, and their names in it (see stats.h).
+enum Counters { COMMANDS_COUNTER, MOVES_COUNTER, INVALID_COUNTER, TIME_COUNTER, PATH_COUNTER, HINT_COUNTER,
+                GAMES_COUNTER, WINS_COUNTER, CLIENTS_COUNTER, NUM_OF_COUNTERS };
+char* counterNames[] = {"commands"
+                       , "moves"
+                       , "invalid"
+                       , "time"
+                       , "path"
+                       , "hint"
+                       , "games"
+                       , "won"
+                       , "clients"};
+
+// Counter of the command that gave each result.
+enum Counters commandCounters[] = { MOVES_COUNTER, INVALID_COUNTER, TIME_COUNTER, PATH_COUNTER, HINT_COUNTER };
+
+// Histogram struct, the times recorded for one metric, counted in buckets of roughly equal relative width.
+struct Histogram
+{
+    uint64_t count;
+    uint64_t total;                 // Sum of the times, in nanoseconds.
+    uint64_t max;
+    uint64_t buckets[NUM_OF_BUCKETS];
+};
+
+// Buffer struct, a growable block of output text.
+struct Buffer
+{
+    char* data;
+    size_t length;
+    size_t capacity;
+};
+
+/* Checkpoint struct, the state of an interactive game saved with -C after every move. The checkpoint file is a
+   header followed by one small record per move, appended as the game goes, see AppendCheckpointRoom(). */
+struct Checkpoint
+{
+    char* filename;
+    char tmpFilename[PATH_MAX];     // A new checkpoint's header is written here, then renamed over filename.
+    int fd;                         // The checkpoint file, open for appending moves.
+    uint64_t worldId;               // Checksum of the world image, the checkpoint only resumes the same world.
+    uint32_t numRooms;
+    uint32_t lastRoom;              // Room the next room of the path is encoded against.
+    uint64_t pathRooms;             // Rooms in the path, one per step.
+    uint64_t chain;                 // Checksum chained through the header and every move so far.
+};
+
+// Header of a checkpoint file, followed by the moves.
+struct CheckpointHeader
+{
+    char magic[8];
+    uint64_t checksum;              // Checksum() of every byte after this field, and the start of the chain.
+    uint32_t version;
+    uint32_t numRooms;              // Rooms in the world.
+    uint64_t worldId;
+};
+
+// RoomText struct, the text of all the room files of a world, read back to back, and the connection names in it.
+struct RoomText
+{
+    struct Buffer text;
+    struct Slice* connections;
+    int numConnections;
+    int connectionsCapacity;
+};
+
+/* CachedRoom struct, the connections of a room loaded on demand. The cached rooms are kept in a list from the most to
+   the least recently used. */
+struct CachedRoom
+{
+    uint32_t room;
+    uint32_t numConnections;
+    struct CachedRoom* newer;
+    struct CachedRoom* older;
+    uint32_t connections[];
+};
+
+/* RoomCache struct, the state of a world whose rooms are read from their room files as they are entered or listed.
+   The world image then only holds the rooms known so far: their names, and their types once loaded. */
+struct RoomCache
+{
+    char dirName[PATH_MAX];
+    size_t capacity;                // Bytes of cached rooms kept, though the room just loaded is always kept.
+    size_t size;
+    struct CachedRoom** rooms;      // Cached room of each known room, or NULL.
+    struct CachedRoom* newest;
+    struct CachedRoom* oldest;
+    uint32_t roomsCapacity;         // Known rooms the arrays have space for.
+    size_t poolCapacity;
+    struct RoomText roomText;       // Text of the last room file read, reused for every file.
+};
+
+// RoomFiles struct, the room files of a rooms directory being read, and the rooms parsed from them.
+struct RoomFiles
+{
+    char* dirName;
+    const char* names;              // Filenames, back to back, each null-terminated.
+    const size_t* nameOffsets;
+    int numFiles;
+    struct Room* rooms;             // Room parsed from each file, in the same order as the filenames.
+    int* readers;                   // Reader thread that read each file, when read by a pool of threads.
+    int nextFile;                   // Next file for a reader thread to read, taken with an atomic add.
+    int failed;                     // Set once a reader thread finds a problem, so the others stop early.
+};
+
+// IoRing struct, an io_uring instance used through raw system calls, with its rings mapped into memory.
+struct IoRing
+{
+    int fd;
+    unsigned entries;
+    unsigned* sqTail;
+    unsigned* sqMask;
+    unsigned* sqArray;
+    struct io_uring_sqe* sqes;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned* cqMask;
+    struct io_uring_cqe* cqes;
+    void* sqRing;
+    size_t sqRingSize;
+    void* cqRing;
+    size_t cqRingSize;
+    size_t sqesSize;
+    unsigned toSubmit;              // Entries queued since the last io_uring_enter().
+};
+
+// Stages of a room file read through io_uring.
+enum ReadStages { FILE_OPENING, FILE_READING, FILE_CLOSING };
+
+// RoomRead struct, one slot of the room files being read through io_uring at the same time.
+struct RoomRead
+{
+    int file;
+    enum ReadStages stage;
+    int fd;
+    char* data;                     // Text read so far, reused by every file read in this slot.
+    size_t length;
+    size_t capacity;
+};
+
+// RoomReader struct, one of the threads reading room files when io_uring is not available.
+struct RoomReader
+{
+    struct RoomFiles* files;
+    int index;
+    struct RoomText text;           // Text of the files this thread read, merged into the world's text afterwards.
+    int errorFile;                  // Lowest numbered file this thread found a problem with, or numFiles.
+    char error[ERROR_BUFFER];
+    pthread_t thread;
+};
+
+// Options struct, holds the command line options.
+struct Options
+{
+    size_t spillLimit;
+    bool writeTimeFile;
+    char* recordFilename;           // File to record the typed commands to, NULL to not record.
+    bool runScripts;                // Run the scripts named after the options instead of an interactive game.
+    char* socketPath;               // Unix domain socket to serve games on, NULL to play an interactive game.
+    int numWorkers;
+    bool validate;                  // Check the worlds named after the options instead of playing.
+    bool benchmark;                 // Benchmark the worlds named after the options instead of playing.
+    char* baselineFilename;         // Earlier benchmark results to compare with, NULL to not compare.
+    int minConnections;             // Connection bounds the validator checks every room against.
+    int maxConnections;
+    size_t cacheSize;               // Bytes of rooms to cache when loading rooms on demand, 0 to load every room.
+    bool usePool;                   // Claim a world of its own from the pool instead of opening the newest world.
+    char* checkpointFilename;       // File to save the game to after every move and resume it from, NULL to not save.
+    bool shareWorld;                // Attach to the world shared by every game on the machine, publishing it if needed.
+};
+
+// Client struct, one player connected to the server.
+struct Client
+{
+    int fd;
+    struct Session session;
+    char command[COMMAND_BUFFER];   // Partial command received so far.
+    size_t commandLength;
+    char input[COMMAND_BUFFER];     // Input received but not yet processed, from inputStart to inputLength.
+    size_t inputStart;
+    size_t inputLength;
+    struct Buffer out;              // Output not yet sent, at most about MAX_CLIENT_OUTPUT bytes.
+    bool finished;                  // The player reached the "ending room" or disconnected.
+    bool ready;                     // poll() found input waiting, so the client is about to be queued.
+    bool moreInput;                 // A task stopped before using up the input, so the client is queued again.
+    struct Client* next;            // Next client in the server's list of clients, or of finished tasks.
+};
+
+// WorkQueue struct, the tasks of one worker thread as a ring buffer of clients with input to process.
+struct WorkQueue
+{
+    pthread_mutex_t mutex;
+    struct Client** tasks;
+    size_t head;                    // Oldest task, which other workers steal from. The owner takes the newest.
+    size_t count;
+    size_t capacity;
+};
+
+// Validator struct, the state shared by the threads checking worlds.
+struct Validator
+{
+    struct Options* options;
+    char** dirs;                    // Rooms directories to check.
+    int numDirs;
+    int nextDir;                    // Next directory to check, taken with an atomic add.
+    int numInvalid;                 // Protected by outputMutex.
+    pthread_mutex_t outputMutex;    // Keeps the reports of different worlds from mixing.
+};
+
+// Worker struct, one thread of the server's worker pool.
+struct Worker
+{
+    struct Server* server;
+    int index;                      // Index of the worker's own queue.
+    pthread_t thread;
+};
+
+// Server struct, the state shared by the poll() loop and the worker threads.
+struct Server
+{
+    struct World* world;
+    struct TimeService* timeService;
+    struct Options* options;
+    int numWorkers;
+    struct Worker* workers;
+    struct WorkQueue* queues;
+    pthread_mutex_t idleMutex;      // Protects numTasks and stopping.
+    pthread_cond_t workAvailable;   // Signalled when a task is queued or the server is stopping.
+    size_t numTasks;                // Tasks queued across all workers.
+    bool stopping;
+    pthread_mutex_t doneMutex;      // Protects doneClients.
+    struct Client* doneClients;     // Clients whose task is finished, waiting to be watched by poll() again.
+    int wakePipe[2];                // Written to wake up the poll() loop.
+};
+
+// TimeService struct, the state shared between the main thread and the second thread that formats the time.
+struct TimeService
+{
+    pthread_t thread;
+    pthread_mutex_t mutex;          // Protects every field below.
+    pthread_cond_t requestReady;    // Signalled when a request is made or the service is stopped.
+    pthread_cond_t responseReady;   // Broadcast when the second thread has answered the requests made so far.
+    unsigned long requests;         // Number of requests made.
+    unsigned long responses;        // Number of requests answered.
+    bool stopping;
+    bool writeFile;                 // Also write the time to "currentTime.txt" when it is requested.
+    time_t cachedMinute;            // Minute (seconds since the epoch / 60) that cachedTime was formatted for.
+    char cachedTime[STR_BUFFER];
+};
+
+/*************************************************************************************************************************
+ * Function Declarations
+*************************************************************************************************************************/
+
+void LoadWorld(struct World* world, struct Options* options);
+bool OpenWorld(struct World* world, char* dirName, char error[]);
+bool MapWorldFile(struct World* world, char* filename, char error[]);
+bool OpenSharedWorld(struct World* world, char* dirName, char error[]);
+bool PublishSharedWorld(struct World* world, int fd, char* dirName, struct stat* dirStat, uint64_t generation,
+                        char error[]);
+bool AttachSharedWorld(struct World* world, int fd, char* name, char error[]);
+void DetachSharedWorld(void);
+bool LockSharedWorld(int fd, short type, off_t byte, bool wait);
+uint64_t AlignShared(uint64_t offset);
+bool InitRooms(struct World* world, char* dirName, char error[]);
+bool ReadRoomFiles(struct RoomFiles* files, struct RoomText* roomText, char error[]);
+bool ReadRoomFilesWithRing(struct IoRing* ring, struct RoomFiles* files, struct RoomText* roomText, char error[]);
+void ParseRoomRead(struct RoomFiles* files, struct RoomRead* read, struct RoomText* roomText, char problem[]);
+bool ReadRoomFilesWithThreads(struct RoomFiles* files, struct RoomText* roomText, char error[]);
+void* ReadRoomFilesOnThread(void* reader);
+bool OpenIoRing(struct IoRing* ring, unsigned entries);
+void CloseIoRing(struct IoRing* ring);
+void QueueIoRingOp(struct IoRing* ring, uint8_t opcode, int fd, void* addr, uint32_t length, uint64_t offset,
+                   uint32_t flags, uint64_t userData);
+void SubmitIoRing(struct IoRing* ring, unsigned minComplete);
+bool ReadRoomFile(char* filename, struct Room* room, struct RoomText* roomText, char error[]);
+bool ParseRoomFile(char* filename, struct Room* room, struct RoomText* roomText, size_t start, char error[]);
+bool IsKey(const char* text, size_t length, const char* expected);
+bool BuildWorldImage(struct World* world, struct Room rooms[], int numRooms, struct RoomText* roomText, char error[]);
+bool OpenLazyWorld(struct World* world, char* dirName, size_t cacheSize, char error[]);
+bool FindStartRoom(struct World* world, char error[]);
+int AddKnownRoom(struct World* world, const char* name, size_t length);
+struct CachedRoom* LoadCachedRoom(struct World* world, int room);
+uint32_t GetConnections(struct World* world, int room, const uint32_t** connections);
+enum Types GetRoomType(struct World* world, int room);
+void FreeWorld(struct World* world);
+bool BuildNameIndex(struct World* world);
+void IndexRoomName(struct World* world, uint32_t room);
+void BuildDistanceOracle(struct World* world);
+uint32_t HashName(const char* name, size_t length);
+int FindRoomIndex(struct World* world, const char* roomName, size_t length);
+void* SafeRealloc(void* ptr, size_t size);
+//char* GetMostRecentDir();
+void GetMostRecentDir(char dirName[]);
+bool ClaimPoolWorld(char dirName[]);
+void ReleasePoolWorld(void);
+void DisplayRoom(struct World* world, int index, struct Buffer* out);
+void AppendText(struct Buffer* buffer, const char* text, size_t length);
+void AppendFormat(struct Buffer* buffer, const char* format, ...);
+void FlushBuffer(struct Buffer* buffer);
+void WritePrompt(struct World* world, struct Session* session, struct Buffer* out);
+void WriteResponse(struct World* world, struct Session* session, enum Results result, char strTime[],
+                   struct Buffer* out);
+void InitSession(struct Session* session, struct World* world, size_t spillLimit);
+void FreeSession(struct Session* session);
+void InitCheckpoint(struct Checkpoint* checkpoint, struct World* world, char* filename);
+bool ResumeCheckpoint(struct Checkpoint* checkpoint, struct World* world, struct Session* session);
+void StartCheckpoint(struct Checkpoint* checkpoint);
+void AppendCheckpointRoom(struct Checkpoint* checkpoint, uint32_t room);
+uint64_t ChainCheckpoint(uint64_t chain, const unsigned char* bytes, size_t length);
+void FreeCheckpoint(struct Checkpoint* checkpoint);
+enum Results ProcessCommand(struct World* world, struct TimeService* timeService, struct Session* session,
+                            char* command, char strTime[]);
+enum Results ExecuteCommand(struct World* world, struct TimeService* timeService, struct Session* session,
+                            char* command, char strTime[]);
+void PlayGame(struct World* world, struct TimeService* timeService, struct Options* options);
+int RunScripts(struct World* world, struct TimeService* timeService, struct Options* options, char* scripts[],
+               int numScripts);
+char* ReadWholeFile(char* filename, size_t* size);
+int RunValidator(struct Options* options, char* paths[], int numPaths);
+void CollectWorldDirs(struct Validator* validator, char* path, bool explicit, int* capacity);
+void* ValidateWorlds(void* validator);
+int ValidateWorld(struct World* world, struct Options* options, char* dirName, struct Buffer* report);
+void ReportProblem(struct Buffer* report, char* dirName, int* numProblems, const char* format, ...);
+int RunBenchmarks(struct Options* options, char* paths[], int numPaths);
+int RunServer(struct World* world, struct TimeService* timeService, struct Options* options);
+void HandleStopSignal(int signalNumber);
+void QueueTask(struct Server* server, struct Client* client, int worker);
+struct Client* TakeTask(struct Server* server, int worker);
+void* RunWorker(void* arg);
+void ProcessClientInput(struct Server* server, struct Client* client);
+void FlushOutput(struct Client* client);
+double ElapsedSeconds(struct timespec* start);
+int GetSelectedRoomIndex(struct World* world, int currentRoomIndex, char* roomName);
+void ParseArgs(int argc, char* argv[], struct Options* options);
+void PrintUsage(char* program);
+void InitPath(struct Path* path, size_t spillLimit);
+void FreePath(struct Path* path);
+void RecordValidChoice(struct Path* path, int roomIndex);
+void AppendRoomNames(struct World* world, const uint32_t* rooms, size_t numRooms, struct Buffer* out);
+void PrintPlayerPath(struct World* world, struct Path* path, struct Buffer* out);
+void StartTimeService(struct TimeService* service, bool writeFile);
+void StopTimeService(struct TimeService* service);
+void* WriteTime(void* service);
+void FormatTime(struct TimeService* service, time_t now);
+void GetTime(struct TimeService* service, char strTime[]);
+void DisplayTime(char strTime[], struct Buffer* out);
+void EnableTiming(char* filename);
+uint64_t StartTiming(void);
+void StopTiming(enum Metrics metric, uint64_t start);
+int GetBucket(uint64_t nanoseconds);
+uint64_t GetPercentile(struct Histogram* histogram, double fraction);
+void DumpTimings(void);
+void EnableStats(char* dirName);
+void CountStat(enum Counters counter);
+void SetStatsLoadTime(uint64_t nanoseconds);
+void RemoveStats(void);
+
+/*************************************************************************************************************************
+ * Main 
+*************************************************************************************************************************/
+
+int main(int argc, char* argv[])
+{
+    // Get the command line options.
+    struct Options options;
+    ParseArgs(argc, argv, &options);
+
+    // Check worlds instead of playing, if asked to.
+    if (options.validate == true)
+    {
+        return RunValidator(&options, argv + optind, argc - optind);
+    }
+
+    // Or run the benchmarks.
+    if (options.benchmark == true)
+    {
+        return RunBenchmarks(&options, argv + optind, argc - optind);
+    }
+
+    // World struct to hold the information for the rooms.
+    struct World world;
+
+    // Start the second thread that provides the time.
+    struct TimeService timeService;
+    StartTimeService(&timeService, options.writeTimeFile);
+
+    // Load the world.
+    LoadWorld(&world, &options);
+
+    // Play an interactive game, run the scripts, or serve games.
+    int status = 0;
+    if (options.runScripts == true)
+    {
+        status = RunScripts(&world, &timeService, &options, argv + optind, argc - optind);
+    }
+    else if (options.socketPath != NULL)
+    {
+        status = RunServer(&world, &timeService, &options);
+    }
+    else
+    {
+        PlayGame(&world, &timeService, &options);
+    }
+
+    // Stop the second thread.
+    StopTimeService(&timeService);
+
+    // Release the world.
+    FreeWorld(&world);
+
+    return status;
+}
+
+/*************************************************************************************************************************
+ * Function Definitions 
+*************************************************************************************************************************/
+
+/* Loads the most recently created world (or, with -P, a world claimed from the pool), from its binary world file if
+   it has one and from its room files otherwise. */
+void LoadWorld(struct World* world, struct Options* options)
+{
+    // Claim a world from the pool, or get the most recently created rooms directory if asked to or the pool is empty.
+    char dirName[PATH_MAX];
+    memset(dirName, '\0', PATH_MAX);
+    struct timespec loadStart;
+    clock_gettime(CLOCK_MONOTONIC, &loadStart);
+    uint64_t start = StartTiming();
+    if (options->usePool == false || ClaimPoolWorld(dirName) == false)
+    {
+        if (options->usePool == true)
+        {
+            fprintf(stderr, "WARNING: No world is ready in the pool, playing the newest world instead.\n");
+        }
+        GetMostRecentDir(dirName);
+    }
+    StopTiming(FIND_WORLD, start);
+
+    // Load it, or report why it could not be loaded.
+    char error[ERROR_BUFFER];
+    start = StartTiming();
+    bool loaded = options->cacheSize > 0 ? OpenLazyWorld(world, dirName, options->cacheSize, error)
+                : options->shareWorld == true ? OpenSharedWorld(world, dirName, error)
+                : OpenWorld(world, dirName, error);
+    if (loaded == false)
+    {
+        printf("ERROR: %s\n", error);
+        exit(1);
+    }
+    StopTiming(LOAD_WORLD, start);
+
+    /* Precompute the shortest paths to the "ending room", which needs every room, so not when loading room files on
+       demand (with -L, a binary world file is mapped whole, so it gets them too). A shared world comes with them. */
+    if (world->cache == NULL && world->shared == false)
+    {
+        start = StartTiming();
+        BuildDistanceOracle(world);
+        StopTiming(BUILD_ORACLE, start);
+    }
+    SetStatsLoadTime(ElapsedSeconds(&loadStart) * 1e9);
+}
+
+/* Loads the world in a rooms directory, from its binary world file if it has one and from its room files otherwise.
+   Returns false with a description of the problem in error if the world cannot be loaded. */
+bool OpenWorld(struct World* world, char* dirName, char error[])
+{
+    memset(world, 0, sizeof(struct World));
+
+    char filename[PATH_MAX];
+    snprintf(filename, sizeof(filename), "%s/%s", dirName, WORLD_FILENAME);
+    if (access(filename, F_OK) == 0)
+    {
+        return MapWorldFile(world, filename, error);
+    }
+    return InitRooms(world, dirName, error);
+}
+
+// Maps a binary world file into memory. Returns false with a description of the problem if it is not valid.
+bool MapWorldFile(struct World* world, char* filename, char error[])
+{
+    int fd;
+    struct stat fileStat;
+
+    if ((fd = open(filename, O_RDONLY)) == -1 || fstat(fd, &fileStat) != 0)
+    {
+        snprintf(error, ERROR_BUFFER, "%s: %s", filename, strerror(errno));
+        if (fd != -1)
+        {
+            close(fd);
+        }
+        return false;
+    }
+    if (fileStat.st_size == 0)
+    {
+        snprintf(error, ERROR_BUFFER, "%s: not a valid world file: file is empty", filename);
+        close(fd);
+        return false;
+    }
+
+    // Map the whole file read-only, the mapping stays valid after the file is closed.
+    void* image = mmap(NULL, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED)
+    {
+        snprintf(error, ERROR_BUFFER, "%s: %s", filename, strerror(errno));
+        return false;
+    }
+    world->mapped = true;
+
+    // Check the header and checksum and set up the section pointers.
+    char* problem = AttachWorldImage(&world->image, image, fileStat.st_size);
+    if (problem != NULL)
+    {
+        snprintf(error, ERROR_BUFFER, "%s: not a valid world file: %s", filename, problem);
+        munmap(image, fileStat.st_size);
+        world->image.data = NULL;
+        return false;
+    }
+
+    // Index the room names.
+    if (BuildNameIndex(world) == false)
+    {
+        snprintf(error, ERROR_BUFFER, "%s: more than one room has the same name", filename);
+        FreeWorld(world);
+        return false;
+    }
+
+    return true;
+}
+
+// Shared world segment this game is attached to, released by DetachSharedWorld(), or -1.
+int sharedFd = -1;
+char sharedName[NAME_MAX];
+uint64_t sharedGeneration;
+struct SharedWorldHeader* sharedHeader = NULL;     // The header, the only writable mapping of the segment.
+unsigned char* sharedData = NULL;                   // The whole segment, mapped read-only.
+
+/* Attaches to the world in a rooms directory through a POSIX shared memory segment named after the directory's path,
+   so that every game playing the same world uses one copy of it. The first game loads the world as OpenWorld() does,
+   builds its indexes and distance oracle and copies them all into the segment, and the games after it only map the
+   segment, which takes microseconds and no memory of their own whatever the size of the world.
+   Games publish, attach to and remove the segment one at a time, under a write lock on its first byte. Every game
+   also holds a read lock on its second byte while it plays, which goes away with the process however it ends, so the
+   last game to leave can tell that it is the last even if others were killed, and removes the segment.
+   Returns false with a description of the problem in error if the world cannot be loaded. */
+bool OpenSharedWorld(struct World* world, char* dirName, char error[])
+{
+    char path[PATH_MAX];
+    struct stat dirStat;
+    struct stat segmentStat;
+    struct SharedWorldHeader header;
+    uint64_t generation = 0;
+    int fd;
+
+    // Name the segment after where the world is, and identify the world by the directory itself.
+    if (realpath(dirName, path) == NULL || stat(path, &dirStat) != 0)
+    {
+        snprintf(error, ERROR_BUFFER, "%s: %s", dirName, strerror(errno));
+        return false;
+    }
+    snprintf(sharedName, sizeof(sharedName), "%s%016llx", SHARED_PREFIX,
+             (unsigned long long) Checksum((unsigned char*) path, strlen(path)));
+    int64_t mtime = (int64_t) dirStat.st_mtim.tv_sec * 1000000000 + dirStat.st_mtim.tv_nsec;
+
+    while (true)
+    {
+        if ((fd = shm_open(sharedName, O_RDWR | O_CREAT, 0644)) == -1)
+        {
+            snprintf(error, ERROR_BUFFER, "%s: %s", sharedName, strerror(errno));
+            return false;
+        }
+        if (LockSharedWorld(fd, F_WRLCK, PUBLISH_LOCK, true) == false || fstat(fd, &segmentStat) != 0)
+        {
+            snprintf(error, ERROR_BUFFER, "%s: %s", sharedName, strerror(errno));
+            close(fd);
+            return false;
+        }
+
+        // The name may have been given to a newer segment while this game waited for the lock: start again with it.
+        int current = shm_open(sharedName, O_RDONLY, 0);
+        struct stat currentStat;
+        bool moved = current == -1 || fstat(current, &currentStat) != 0 || currentStat.st_ino != segmentStat.st_ino;
+        if (current != -1)
+        {
+            close(current);
+        }
+        if (moved == true)
+        {
+            close(fd);
+            continue;
+        }
+
+        // A new segment reads as zeroes, which is not ready.
+        memset(&header, 0, sizeof(header));
+        if (segmentStat.st_size >= (off_t) sizeof(header) && pread(fd, &header, sizeof(header), 0) != sizeof(header))
+        {
+            memset(&header, 0, sizeof(header));
+        }
+        bool ready = memcmp(header.magic, SHARED_MAGIC, sizeof(header.magic)) == 0
+                     && header.version == SHARED_VERSION && header.ready == 1 && segmentStat.st_size >= 0
+                     && header.size == (uint64_t) segmentStat.st_size;
+        bool sameWorld = header.worldDev == dirStat.st_dev && header.worldIno == dirStat.st_ino
+                         && header.worldMtime == mtime;
+
+        // The world is there already: attach to it.
+        if (ready == true && sameWorld == true)
+        {
+            return AttachSharedWorld(world, fd, sharedName, error);
+        }
+
+        /* Another world has replaced this one under the same path: remove the name so the new world can be published
+           under it, leaving the old segment to the games still playing it, and start again. */
+        if (ready == true)
+        {
+            generation = header.generation > generation ? header.generation : generation;
+            shm_unlink(sharedName);
+            close(fd);
+            continue;
+        }
+
+        // The segment is new, or a game died while filling it in: fill it in.
+        generation = header.generation > generation ? header.generation : generation;
+        return PublishSharedWorld(world, fd, dirName, &dirStat, generation + 1, error);
+    }
+}
+
+/* Loads the world in a rooms directory and copies it and its indexes into a shared world segment, which the caller
+   holds the publish lock on, then attaches to the segment. Returns false with a description of the problem in error
+   if the world cannot be loaded. */
+bool PublishSharedWorld(struct World* world, int fd, char* dirName, struct stat* dirStat, uint64_t generation,
+                        char error[])
+{
+    struct World loaded;
+    struct SharedWorldHeader header;
+
+    // Nothing has attached to a segment that is not ready, so a world that cannot be loaded takes the segment with it.
+    if (OpenWorld(&loaded, dirName, error) == false)
+    {
+        shm_unlink(sharedName);
+        close(fd);
+        return false;
+    }
+    BuildDistanceOracle(&loaded);
+
+    // Lay out the segment: the header, the world image, then the name index, distances and next hops.
+    uint32_t numRooms = loaded.image.numRooms;
+    size_t indexSize = sizeof(uint32_t) * ((size_t) loaded.nameIndexMask + 1);
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SHARED_MAGIC, sizeof(header.magic));
+    header.version = SHARED_VERSION;
+    header.generation = generation;
+    header.worldDev = dirStat->st_dev;
+    header.worldIno = dirStat->st_ino;
+    header.worldMtime = (int64_t) dirStat->st_mtim.tv_sec * 1000000000 + dirStat->st_mtim.tv_nsec;
+    header.imageOffset = AlignShared(sizeof(header));
+    header.nameIndexOffset = AlignShared(header.imageOffset + loaded.image.size);
+    header.distancesOffset = AlignShared(header.nameIndexOffset + indexSize);
+    header.nextHopsOffset = AlignShared(header.distancesOffset + sizeof(uint32_t) * (uint64_t) numRooms);
+    header.size = header.nextHopsOffset + sizeof(uint32_t) * (uint64_t) numRooms;
+    header.nameIndexMask = loaded.nameIndexMask;
+
+    // Empty the segment first so that nothing left by a game that died while filling it in survives.
+    unsigned char* data = MAP_FAILED;
+    if (ftruncate(fd, 0) != 0 || ftruncate(fd, header.size) != 0
+        || (data = mmap(NULL, header.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+    {
+        snprintf(error, ERROR_BUFFER, "%s: %s", sharedName, strerror(errno));
+        FreeWorld(&loaded);
+        shm_unlink(sharedName);
+        close(fd);
+        return false;
+    }
+    memcpy(data + header.imageOffset, loaded.image.data, loaded.image.size);
+    memcpy(data + header.nameIndexOffset, loaded.nameIndex, indexSize);
+    memcpy(data + header.distancesOffset, loaded.distances, sizeof(uint32_t) * (size_t) numRooms);
+    memcpy(data + header.nextHopsOffset, loaded.nextHops, sizeof(uint32_t) * (size_t) numRooms);
+
+    // Mark it ready last.
+    memcpy(data, &header, sizeof(header));
+    __atomic_store_n(&((struct SharedWorldHeader*) data)->ready, 1, __ATOMIC_RELEASE);
+    munmap(data, header.size);
+    FreeWorld(&loaded);
+
+    return AttachSharedWorld(world, fd, sharedName, error);
+}
+
+/* Maps a ready shared world segment, which the caller holds the publish lock on, and points the world at it. The
+   publish lock is released, and the player lock held until the game detaches. Returns false with a description of
+   the problem in error if the segment cannot be mapped. */
+bool AttachSharedWorld(struct World* world, int fd, char* name, char error[])
+{
+    struct SharedWorldHeader header;
+
+    memset(world, 0, sizeof(struct World));
+    if (pread(fd, &header, sizeof(header), 0) != sizeof(header)
+        || (sharedData = mmap(NULL, header.size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED
+        || (sharedHeader = mmap(NULL, sizeof(header), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+    {
+        snprintf(error, ERROR_BUFFER, "%s: %s", name, strerror(errno));
+        if (sharedData != MAP_FAILED && sharedData != NULL)
+        {
+            munmap(sharedData, header.size);
+        }
+        sharedData = NULL;
+        sharedHeader = NULL;
+        close(fd);
+        return false;
+    }
+
+    // The image was checked (or built) by the game that published it, so only the section pointers are set up.
+    AttachSealedWorldImage(&world->image, sharedData + header.imageOffset);
+    world->nameIndex = (uint32_t*) (sharedData + header.nameIndexOffset);
+    world->nameIndexMask = header.nameIndexMask;
+    world->distances = (uint32_t*) (sharedData + header.distancesOffset);
+    world->nextHops = (uint32_t*) (sharedData + header.nextHopsOffset);
+    world->shared = true;
+
+    __atomic_add_fetch(&sharedHeader->refCount, 1, __ATOMIC_SEQ_CST);
+    sharedGeneration = header.generation;
+    sharedFd = fd;
+    LockSharedWorld(fd, F_RDLCK, PLAYER_LOCK, true);
+    LockSharedWorld(fd, F_UNLCK, PUBLISH_LOCK, true);
+    atexit(DetachSharedWorld);
+    return true;
+}
+
+/* Detaches from the shared world segment. The last game to detach, the only one that can write lock the player
+   lock, removes the segment, unless its name has been taken by a newer world since. */
+void DetachSharedWorld(void)
+{
+    struct SharedWorldHeader header;
+
+    if (sharedFd == -1)
+    {
+        return;
+    }
+    __atomic_sub_fetch(&sharedHeader->refCount, 1, __ATOMIC_SEQ_CST);
+    munmap(sharedData, sharedHeader->size);
+    munmap(sharedHeader, sizeof(struct SharedWorldHeader));
+    sharedData = NULL;
+    sharedHeader = NULL;
+
+    // No game can attach while the publish lock is held, so no other game holds the player lock once it is taken.
+    LockSharedWorld(sharedFd, F_WRLCK, PUBLISH_LOCK, true);
+    LockSharedWorld(sharedFd, F_UNLCK, PLAYER_LOCK, true);
+    if (LockSharedWorld(sharedFd, F_WRLCK, PLAYER_LOCK, false) == true)
+    {
+        int current = shm_open(sharedName, O_RDONLY, 0);
+        if (current != -1)
+        {
+            if (pread(current, &header, sizeof(header), 0) == sizeof(header) && header.generation == sharedGeneration)
+            {
+                shm_unlink(sharedName);
+            }
+            close(current);
+        }
+    }
+    close(sharedFd);
+    sharedFd = -1;
+}
+
+/* Locks (F_RDLCK or F_WRLCK) or unlocks (F_UNLCK) one byte of a shared world segment. The locks belong to the open
+   segment rather than the process, and are released when it is closed. Returns false if the lock is held elsewhere
+   and wait is false, or on error. */
+bool LockSharedWorld(int fd, short type, off_t byte, bool wait)
+{
+    struct flock lock;
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = type;
+    lock.l_whence = SEEK_SET;
+    lock.l_start = byte;
+    lock.l_len = 1;
+    return fcntl(fd, wait == true ? F_OFD_SETLKW : F_OFD_SETLK, &lock) == 0;
+}
+
+// Rounds an offset in a shared world segment up to the next cache line.
+uint64_t AlignShared(uint64_t offset)
+{
+    return (offset + SHARED_ALIGN - 1) & ~((uint64_t) SHARED_ALIGN - 1);
+}
+
+/* Reads the room files from the given rooms directory and builds the world image from them.
+   Returns false with a description of the problem if a file cannot be read or the rooms do not make a world. */
+bool InitRooms(struct World* world, char* dirName, char error[])
+{
+    // Variables for navigating the rooms directory.
+    DIR* dir;
+    struct dirent* dirEntry;
+
+    // Variables to store the names of the room files, back to back.
+    struct Buffer filenames = {NULL, 0, 0};
+    size_t* filenameOffsets = NULL;
+    int numFiles = 0;
+    int filenamesCapacity = 0;
+
+    // Variables to hold the rooms and the text of their files until the world image is built.
+    struct Room* rooms;
+    struct RoomText roomText = {{NULL, 0, 0}, NULL, 0, 0};
+
+    // Open the directory.
+    if ((dir = opendir(dirName)) == NULL)
+    {
+        snprintf(error, ERROR_BUFFER, "%s: %s", dirName, strerror(errno));
+        return false;
+    }
+
+    // Loop through all the files in the opened rooms directory and get the filenames.
+    while ((dirEntry = readdir(dir)) != NULL)
+    {
+        // If the file is a regular file (not a directory) named like a room file ("room-name_room").
+        size_t nameLength = strlen(dirEntry->d_name);
+        if (dirEntry->d_type == DT_REG && nameLength > 5 && strcmp(dirEntry->d_name + nameLength - 5, "_room") == 0)
+        {
+            // Capture the name of the file ("room-name_room").
+            if (numFiles == filenamesCapacity)
+            {
+                filenamesCapacity = filenamesCapacity == 0 ? 64 : filenamesCapacity * 2;
+                filenameOffsets = SafeRealloc(filenameOffsets, sizeof(size_t) * filenamesCapacity);
+            }
+            filenameOffsets[numFiles++] = filenames.length;
+            AppendText(&filenames, dirEntry->d_name, nameLength + 1);
+        }
+    }
+    closedir(dir);
+
+    if (numFiles == 0)
+    {
+        snprintf(error, ERROR_BUFFER, "%s: there are no room files", dirName);
+        return false;
+    }
+    rooms = SafeRealloc(NULL, sizeof(struct Room) * numFiles);
+
+    // Read all the files into rooms[], then convert the rooms into a world image, resolving the connection names
+    // into room indexes.
+    struct RoomFiles files = {dirName, filenames.data, filenameOffsets, numFiles, rooms, NULL, 0, 0};
+    bool loaded = ReadRoomFiles(&files, &roomText, error);
+    if (loaded == true)
+    {
+        char problem[ERROR_BUFFER];
+        if ((loaded = BuildWorldImage(world, rooms, numFiles, &roomText, problem)) == false)
+        {
+            snprintf(error, ERROR_BUFFER, "%s: %.200s", dirName, problem);
+        }
+    }
+
+    free(filenames.data);
+    free(filenameOffsets);
+    free(rooms);
+    free(roomText.text.data);
+    free(roomText.connections);
+    return loaded;
+}
+
+/* Reads and parses every room file of a rooms directory into the rooms, in the order of the filenames, with the
+   text of every file going into roomText. The files are opened, read and closed asynchronously through io_uring
+   when the kernel supports it, and by a pool of threads otherwise. Returns false with the problem if a file cannot
+   be read or is not a valid room file. */
+bool ReadRoomFiles(struct RoomFiles* files, struct RoomText* roomText, char error[])
+{
+    struct IoRing ring;
+    if (OpenIoRing(&ring, READ_QUEUE_DEPTH) == true)
+    {
+        bool loaded = ReadRoomFilesWithRing(&ring, files, roomText, error);
+        CloseIoRing(&ring);
+        return loaded;
+    }
+    return ReadRoomFilesWithThreads(files, roomText, error);
+}
+
+/* Reads the room files through io_uring, keeping up to one file per slot of the ring in flight. A file is opened,
+   then read (in chunks if it outgrows its slot's buffer), then parsed as soon as its read completes, while its close
+   and the other files' operations go on in the background. Once a problem is found, no more files are opened and the
+   problem of the lowest numbered file is reported. */
+bool ReadRoomFilesWithRing(struct IoRing* ring, struct RoomFiles* files, struct RoomText* roomText, char error[])
+{
+    int dirFd;
+    if ((dirFd = open(files->dirName, O_RDONLY | O_DIRECTORY)) == -1)
+    {
+        snprintf(error, ERROR_BUFFER, "%s: %s", files->dirName, strerror(errno));
+        return false;
+    }
+
+    // Every slot starts out free.
+    int numSlots = ring->entries;
+    struct RoomRead* slots = SafeRealloc(NULL, sizeof(struct RoomRead) * numSlots);
+    int* freeSlots = SafeRealloc(NULL, sizeof(int) * numSlots);
+    int numFree = 0;
+    int i;
+    for (i = numSlots - 1; i >= 0; i--)
+    {
+        slots[i].capacity = ROOM_READ_SIZE;
+        slots[i].data = SafeRealloc(NULL, slots[i].capacity);
+        freeSlots[numFree++] = i;
+    }
+
+    int nextFile = 0;
+    int inFlight = 0;
+    int errorFile = files->numFiles;
+    while (true)
+    {
+        // Open the next files in the free slots, relative to the directory so the filenames need no copying.
+        while (numFree > 0 && nextFile < files->numFiles && errorFile == files->numFiles)
+        {
+            int slot = freeSlots[--numFree];
+            slots[slot].file = nextFile++;
+            slots[slot].stage = FILE_OPENING;
+            QueueIoRingOp(ring, IORING_OP_OPENAT, dirFd, (void*) (files->names + files->nameOffsets[slots[slot].file]),
+                          0, 0, O_RDONLY, slot);
+            inFlight++;
+        }
+        if (inFlight == 0)
+        {
+            break;
+        }
+
+        // Submit the queued operations and wait for at least one to complete.
+        SubmitIoRing(ring, 1);
+
+        // Handle every completion, queueing the next operation of its file.
+        unsigned head = *ring->cqHead;
+        unsigned tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++)
+        {
+            struct io_uring_cqe* cqe = &ring->cqes[head & *ring->cqMask];
+            struct RoomRead* read = &slots[cqe->user_data];
+            const char* name = files->names + files->nameOffsets[read->file];
+            char problem[ERROR_BUFFER];
+            problem[0] = '\0';
+            bool done = true;
+
+            switch (read->stage)
+            {
+                case FILE_OPENING:
+                    if (cqe->res < 0)
+                    {
+                        snprintf(problem, sizeof(problem), "%s/%s: %s", files->dirName, name, strerror(-cqe->res));
+                    }
+                    else
+                    {
+                        read->fd = cqe->res;
+                        read->length = 0;
+                        read->stage = FILE_READING;
+                        QueueIoRingOp(ring, IORING_OP_READ, read->fd, read->data, read->capacity, 0, 0,
+                                      cqe->user_data);
+                        done = false;
+                    }
+                    break;
+                case FILE_READING:
+                    if (cqe->res < 0)
+                    {
+                        snprintf(problem, sizeof(problem), "%s/%s: %s", files->dirName, name, strerror(-cqe->res));
+                    }
+                    else if ((read->length += cqe->res) < read->capacity)
+                    {
+                        ParseRoomRead(files, read, roomText, problem);
+                    }
+                    else if (read->capacity > MAX_ROOM_FILE)
+                    {
+                        snprintf(problem, sizeof(problem), "%s/%s: room file is larger than %d bytes",
+                                 files->dirName, name, MAX_ROOM_FILE);
+                    }
+                    else
+                    {
+                        // The buffer is full, so grow it and read on.
+                        read->capacity = read->capacity * 2 > MAX_ROOM_FILE ? MAX_ROOM_FILE + 1 : read->capacity * 2;
+                        read->data = SafeRealloc(read->data, read->capacity);
+                        QueueIoRingOp(ring, IORING_OP_READ, read->fd, read->data + read->length,
+                                      read->capacity - read->length, read->length, 0, cqe->user_data);
+                        done = false;
+                        break;
+                    }
+
+                    // Close the file whatever came of the read.
+                    read->stage = FILE_CLOSING;
+                    QueueIoRingOp(ring, IORING_OP_CLOSE, read->fd, NULL, 0, 0, 0, cqe->user_data);
+                    done = false;
+                    break;
+                case FILE_CLOSING:
+                    break;
+            }
+
+            // Keep the problem of the lowest numbered file, the one a serial read would have found first.
+            if (problem[0] != '\0' && read->file < errorFile)
+            {
+                errorFile = read->file;
+                memcpy(error, problem, ERROR_BUFFER);
+            }
+            if (done == true)
+            {
+                freeSlots[numFree++] = cqe->user_data;
+                inFlight--;
+            }
+        }
+        __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+    }
+
+    close(dirFd);
+    for (i = 0; i < numSlots; i++)
+    {
+        free(slots[i].data);
+    }
+    free(slots);
+    free(freeSlots);
+    return errorFile == files->numFiles;
+}
+
+// Parses a room file read through io_uring, after adding its text to the text of the room files.
+void ParseRoomRead(struct RoomFiles* files, struct RoomRead* read, struct RoomText* roomText, char problem[])
+{
+    char filename[PATH_MAX];
+    size_t start = roomText->text.length;
+
+    AppendText(&roomText->text, read->data, read->length);
+    snprintf(filename, sizeof(filename), "%s/%s", files->dirName, files->names + files->nameOffsets[read->file]);
+    ParseRoomFile(filename, &files->rooms[read->file], roomText, start, problem);
+}
+
+/* Reads the room files on a pool of threads (one per core, up to MAX_READERS), for kernels without io_uring. Each
+   thread takes the next file with an atomic add and reads it onto its own text, and the texts are joined once every
+   thread is done. */
+bool ReadRoomFilesWithThreads(struct RoomFiles* files, struct RoomText* roomText, char error[])
+{
+    int numReaders = sysconf(_SC_NPROCESSORS_ONLN);
+    numReaders = numReaders > MAX_READERS ? MAX_READERS : numReaders;
+    numReaders = numReaders > files->numFiles ? files->numFiles : numReaders;
+    numReaders = numReaders < 1 ? 1 : numReaders;
+
+    // The first reader reads onto the world's text and runs on the calling thread.
+    struct RoomReader* readers = SafeRealloc(NULL, sizeof(struct RoomReader) * numReaders);
+    files->readers = SafeRealloc(NULL, sizeof(int) * files->numFiles);
+    int i, j;
+    for (i = 0; i < numReaders; i++)
+    {
+        readers[i].files = files;
+        readers[i].index = i;
+        readers[i].text = i == 0 ? *roomText : (struct RoomText) {{NULL, 0, 0}, NULL, 0, 0};
+        readers[i].errorFile = files->numFiles;
+    }
+    for (i = 1; i < numReaders; i++)
+    {
+        if (pthread_create(&readers[i].thread, NULL, ReadRoomFilesOnThread, &readers[i]) != 0)
+        {
+            printf("ERROR: There was a problem creating a thread\n");
+            perror("In ReadRoomFilesWithThreads() with pthread_create()");
+            exit(1);
+        }
+    }
+    ReadRoomFilesOnThread(&readers[0]);
+    for (i = 1; i < numReaders; i++)
+    {
+        pthread_join(readers[i].thread, NULL);
+    }
+    *roomText = readers[0].text;
+
+    // Report the problem of the lowest numbered file, or join the texts of the other readers onto the world's text,
+    // moving the slices of the rooms they read along with them.
+    int errorReader = 0;
+    for (i = 1; i < numReaders; i++)
+    {
+        if (readers[i].errorFile < readers[errorReader].errorFile)
+        {
+            errorReader = i;
+        }
+    }
+    bool loaded = readers[errorReader].errorFile == files->numFiles;
+    if (loaded == false)
+    {
+        memcpy(error, readers[errorReader].error, ERROR_BUFFER);
+    }
+    size_t* textShifts = SafeRealloc(NULL, sizeof(size_t) * numReaders);
+    int* connectionShifts = SafeRealloc(NULL, sizeof(int) * numReaders);
+    textShifts[0] = 0;
+    connectionShifts[0] = 0;
+    for (i = 1; i < numReaders; i++)
+    {
+        struct RoomText* text = &readers[i].text;
+        textShifts[i] = roomText->text.length;
+        connectionShifts[i] = roomText->numConnections;
+        if (loaded == true)
+        {
+            AppendText(&roomText->text, text->text.data == NULL ? "" : text->text.data, text->text.length);
+            if (roomText->numConnections + text->numConnections > roomText->connectionsCapacity)
+            {
+                roomText->connectionsCapacity = roomText->numConnections + text->numConnections;
+                roomText->connections = SafeRealloc(roomText->connections,
+                                                    sizeof(struct Slice) * roomText->connectionsCapacity);
+            }
+            for (j = 0; j < text->numConnections; j++)
+            {
+                roomText->connections[roomText->numConnections] = text->connections[j];
+                roomText->connections[roomText->numConnections++].offset += textShifts[i];
+            }
+        }
+        free(text->text.data);
+        free(text->connections);
+    }
+    if (loaded == true && numReaders > 1)
+    {
+        for (i = 0; i < files->numFiles; i++)
+        {
+            files->rooms[i].name.offset += textShifts[files->readers[i]];
+            files->rooms[i].firstConnection += connectionShifts[files->readers[i]];
+        }
+    }
+
+    free(textShifts);
+    free(connectionShifts);
+    free(files->readers);
+    files->readers = NULL;
+    free(readers);
+    return loaded;
+}
+
+// Reads room files until there are none left or a problem is found, the body of each thread of the reader pool.
+void* ReadRoomFilesOnThread(void* arg)
+{
+    struct RoomReader* reader = (struct RoomReader*) arg;
+    struct RoomFiles* files = reader->files;
+    char filename[PATH_MAX];
+    int file;
+
+    while (__atomic_load_n(&files->failed, __ATOMIC_RELAXED) == 0
+           && (file = __sync_fetch_and_add(&files->nextFile, 1)) < files->numFiles)
+    {
+        snprintf(filename, sizeof(filename), "%s/%s", files->dirName, files->names + files->nameOffsets[file]);
+        files->readers[file] = reader->index;
+        if (ReadRoomFile(filename, &files->rooms[file], &reader->text, reader->error) == false)
+        {
+            reader->errorFile = file;
+            __atomic_store_n(&files->failed, 1, __ATOMIC_RELAXED);
+        }
+    }
+
+    return NULL;
+}
+
+/* Sets up an io_uring instance with the given number of entries and maps its rings. Returns false if the kernel does
+   not have io_uring (or it is disabled), or is older than Linux 5.7: opening, reading and closing files through
+   io_uring came in 5.6, and IORING_FEAT_FAST_POLL is the first feature flag that guarantees them. */
+bool OpenIoRing(struct IoRing* ring, unsigned entries)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    memset(ring, 0, sizeof(struct IoRing));
+
+    if ((ring->fd = syscall(__NR_io_uring_setup, entries, &params)) < 0)
+    {
+        return false;
+    }
+    if ((params.features & IORING_FEAT_FAST_POLL) == 0)
+    {
+        close(ring->fd);
+        return false;
+    }
+
+    // Map the submission queue ring, its entries and the completion queue ring.
+    ring->entries = params.sq_entries;
+    ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqRing = mmap(NULL, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+                        IORING_OFF_SQ_RING);
+    ring->cqRing = mmap(NULL, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+                        IORING_OFF_CQ_RING);
+    ring->sqes = mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+                      IORING_OFF_SQES);
+    if (ring->sqRing == MAP_FAILED || ring->cqRing == MAP_FAILED || ring->sqes == MAP_FAILED)
+    {
+        CloseIoRing(ring);
+        return false;
+    }
+
+    char* sq = ring->sqRing;
+    char* cq = ring->cqRing;
+    ring->sqTail = (unsigned*) (sq + params.sq_off.tail);
+    ring->sqMask = (unsigned*) (sq + params.sq_off.ring_mask);
+    ring->sqArray = (unsigned*) (sq + params.sq_off.array);
+    ring->cqHead = (unsigned*) (cq + params.cq_off.head);
+    ring->cqTail = (unsigned*) (cq + params.cq_off.tail);
+    ring->cqMask = (unsigned*) (cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*) (cq + params.cq_off.cqes);
+    return true;
+}
+
+// Unmaps the rings of an io_uring instance and closes it.
+void CloseIoRing(struct IoRing* ring)
+{
+    if (ring->sqRing != NULL && ring->sqRing != MAP_FAILED)
+        munmap(ring->sqRing, ring->sqRingSize);
+    if (ring->cqRing != NULL && ring->cqRing != MAP_FAILED)
+        munmap(ring->cqRing, ring->cqRingSize);
+    if (ring->sqes != NULL && ring->sqes != MAP_FAILED)
+        munmap(ring->sqes, ring->sqesSize);
+    close(ring->fd);
+}
+
+/* Queues an operation on the submission queue of an io_uring instance, to be submitted by the next SubmitIoRing().
+   The caller never has more operations in flight than the ring has entries, so there is always a free entry. */
+void QueueIoRingOp(struct IoRing* ring, uint8_t opcode, int fd, void* addr, uint32_t length, uint64_t offset,
+                   uint32_t flags, uint64_t userData)
+{
+    unsigned tail = *ring->sqTail;
+    unsigned index = tail & *ring->sqMask;
+    struct io_uring_sqe* sqe = &ring->sqes[index];
+
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t) (uintptr_t) addr;
+    sqe->len = length;
+    sqe->off = offset;
+    sqe->open_flags = flags;
+    sqe->user_data = userData;
+    ring->sqArray[index] = index;
+
+    // Publish the entry to the kernel only once it is filled in.
+    __atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+    ring->toSubmit++;
+}
+
+// Submits the queued operations of an io_uring instance and waits until at least minComplete have completed.
+void SubmitIoRing(struct IoRing* ring, unsigned minComplete)
+{
+    int result;
+    while ((result = syscall(__NR_io_uring_enter, ring->fd, ring->toSubmit, minComplete,
+                             minComplete > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0)) < 0)
+    {
+        if (errno != EINTR)
+        {
+            printf("ERROR: Failed to submit reads to io_uring\n");
+            perror("In SubmitIoRing()");
+            exit(1);
+        }
+    }
+    ring->toSubmit -= result;
+}
+
+/* Reads a whole room file with one read() onto the end of the text of the room files, and parses it into a room.
+   Returns false with the problem if the file cannot be read or is not a valid room file. */
+bool ReadRoomFile(char* filename, struct Room* room, struct RoomText* roomText, char error[])
+{
+    int fd;
+    struct stat fileStat;
+
+    if ((fd = open(filename, O_RDONLY)) == -1 || fstat(fd, &fileStat) != 0)
+    {
+        snprintf(error, ERROR_BUFFER, "%s: %s", filename, strerror(errno));
+        if (fd != -1)
+        {
+            close(fd);
+        }
+        return false;
+    }
+    if (fileStat.st_size > MAX_ROOM_FILE)
+    {
+        snprintf(error, ERROR_BUFFER, "%s: room file is larger than %d bytes", filename, MAX_ROOM_FILE);
+        close(fd);
+        return false;
+    }
+
+    // Make space for the whole file, growing the text geometrically.
+    struct Buffer* text = &roomText->text;
+    size_t start = text->length;
+    size_t size = fileStat.st_size;
+    if (start + size > text->capacity)
+    {
+        text->capacity = text->capacity * 2 > start + size ? text->capacity * 2 : start + size;
+        text->data = SafeRealloc(text->data, text->capacity);
+    }
+
+    // Read it, which takes a single read() unless the read is interrupted.
+    size_t numRead = 0;
+    while (numRead < size)
+    {
+        ssize_t result = read(fd, text->data + start + numRead, size - numRead);
+        if (result < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (result < 0)
+        {
+            snprintf(error, ERROR_BUFFER, "%s: %s", filename, strerror(errno));
+            close(fd);
+            return false;
+        }
+        if (result == 0)
+        {
+            break;  // The file got shorter since fstat(), parse what is there.
+        }
+        numRead += result;
+    }
+    close(fd);
+    text->length = start + numRead;
+
+    return ParseRoomFile(filename, room, roomText, start, error);
+}
+
+/* Parses the text of one room file, from start to the end of the text, into a room. Every line is "KEY: value",
+   with the keys ROOM NAME, CONNECTION <number> and ROOM TYPE in any order, and the room's name and connections are
+   kept as slices of the text rather than copied. Returns false with the file and line of the problem if the file
+   is not a valid room file. */
+bool ParseRoomFile(char* filename, struct Room* room, struct RoomText* roomText, size_t start, char error[])
+{
+    char* text = roomText->text.data;
+    size_t position = start;
+    size_t end = roomText->text.length;
+    int lineNumber = 0;
+    bool hasName = false;
+    bool hasType = false;
+
+    room->numConnections = 0;
+    room->firstConnection = roomText->numConnections;
+
+    while (position < end)
+    {
+        // Find the end of the line, and move past it for the next one.
+        char* line = text + position;
+        char* newline = memchr(line, '\n', end - position);
+        size_t lineLength = newline != NULL ? (size_t) (newline - line) : end - position;
+        position += lineLength + (newline != NULL ? 1 : 0);
+        lineNumber++;
+
+        if (lineLength > 0 && line[lineLength-1] == '\r')
+        {
+            lineLength--;
+        }
+        if (lineLength == 0)
+        {
+            continue;
+        }
+
+        // Split the line into its key and value at the first ": ".
+        char* colon = memchr(line, ':', lineLength);
+        if (colon == NULL || colon + 1 == line + lineLength || colon[1] != ' ')
+        {
+            snprintf(error, ERROR_BUFFER, "%s:%d: expected a line of the form \"KEY: value\"", filename, lineNumber);
+            return false;
+        }
+        size_t keyLength = colon - line;
+        struct Slice value = {colon + 2 - text, line + lineLength - (colon + 2)};
+
+        // Every value is a single word.
+        size_t i;
+        bool validValue = value.length > 0 && value.length <= MAX_NAME_LENGTH;
+        for (i = 0; i < value.length && validValue == true; i++)
+        {
+            validValue = (unsigned char) text[value.offset + i] > ' ';
+        }
+        if (validValue == false)
+        {
+            snprintf(error, ERROR_BUFFER, "%s:%d: expected a value of 1 to %d characters without spaces", filename,
+                     lineNumber, MAX_NAME_LENGTH);
+            return false;
+        }
+
+        if (IsKey(line, keyLength, "ROOM NAME"))
+        {
+            if (hasName == true)
+            {
+                snprintf(error, ERROR_BUFFER, "%s:%d: more than one ROOM NAME", filename, lineNumber);
+                return false;
+            }
+            room->name = value;
+            hasName = true;
+        }
+        else if (IsKey(line, keyLength, "ROOM TYPE"))
+        {
+            int type;
+            for (type = START_ROOM; type <= END_ROOM && IsKey(text + value.offset, value.length, types[type]) == false;
+                 type++)
+            {
+            }
+            if (hasType == true || type > END_ROOM)
+            {
+                snprintf(error, ERROR_BUFFER, "%s:%d: %s", filename, lineNumber, hasType == true
+                         ? "more than one ROOM TYPE" : "expected a room type of START_ROOM, MID_ROOM or END_ROOM");
+                return false;
+            }
+            room->type = type;
+            hasType = true;
+        }
+        else if (keyLength > 11 && memcmp(line, "CONNECTION ", 11) == 0
+                 && strspn(line + 11, "0123456789") >= keyLength - 11)
+        {
+            // Make room for another connection name.
+            if (roomText->numConnections == roomText->connectionsCapacity)
+            {
+                roomText->connectionsCapacity = roomText->connectionsCapacity == 0 ? 64
+                                                                                   : roomText->connectionsCapacity * 2;
+                roomText->connections = SafeRealloc(roomText->connections,
+                                                    sizeof(struct Slice) * roomText->connectionsCapacity);
+            }
+            roomText->connections[roomText->numConnections++] = value;
+            room->numConnections++;
+        }
+        else
+        {
+            snprintf(error, ERROR_BUFFER, "%s:%d: unknown key \"%.*s\"", filename, lineNumber,
+                     keyLength > STR_BUFFER ? STR_BUFFER : (int) keyLength, line);
+            return false;
+        }
+    }
+
+    if (hasName == false || hasType == false)
+    {
+        snprintf(error, ERROR_BUFFER, "%s: there is no %s", filename, hasName == false ? "ROOM NAME" : "ROOM TYPE");
+        return false;
+    }
+    return true;
+}
+
+// Returns true if the text of the given length is exactly the expected key.
+bool IsKey(const char* text, size_t length, const char* expected)
+{
+    return strlen(expected) == length && memcmp(text, expected, length) == 0;
+}
+
+/* Builds a world image in memory from rooms read from the room files, in the same layout as a binary world file.
+   Returns false with a description of the problem if the rooms do not make a world. */
+bool BuildWorldImage(struct World* world, struct Room rooms[], int numRooms, struct RoomText* roomText, char error[])
+{
+    const char* text = roomText->text.data;
+    struct WorldImage* image = &world->image;
+    int i, j, k;
+
+    // Count the links and the size of the string pool.
+    size_t numLinks = 0;
+    size_t poolSize = 0;
+    for (i = 0; i < numRooms; i++)
+    {
+        numLinks += rooms[i].numConnections;
+        poolSize += rooms[i].name.length + 1;
+    }
+
+    // Lay out the sections.
+    size_t size = GetWorldImageSize(numRooms, numLinks, poolSize);
+    unsigned char* data = SafeRealloc(NULL, size);
+    memset(data, 0, size);
+    InitWorldImage(image, data, numRooms, numLinks, poolSize);
+    world->mapped = false;
+
+    // Fill in the room types, the name offsets and the string pool (which is already zeroed, so every name is
+    // null-terminated).
+    uint32_t poolIndex = 0;
+    for (i = 0; i < numRooms; i++)
+    {
+        size_t nameLength = rooms[i].name.length;
+        image->nameOffsets[i] = poolIndex;
+        image->types[i] = rooms[i].type;
+        memcpy(image->stringPool + poolIndex, text + rooms[i].name.offset, nameLength);
+        poolIndex += nameLength + 1;
+
+        if (rooms[i].type == START_ROOM)
+            image->startRoom = i;
+        else if (rooms[i].type == END_ROOM)
+            image->endRoom = i;
+    }
+    image->nameOffsets[numRooms] = poolIndex;
+
+    // Index the room names, which only needs the name offsets and string pool to be in place.
+    if (BuildNameIndex(world) == false)
+    {
+        snprintf(error, ERROR_BUFFER, "there is more than one room file with the same room name");
+        FreeWorld(world);
+        return false;
+    }
+
+    // Fill in the CSR connection arrays, resolving each connection name into a room index.
+    uint32_t linkIndex = 0;
+    for (i = 0; i < numRooms; i++)
+    {
+        image->linkOffsets[i] = linkIndex;
+        for (j = 0; j < rooms[i].numConnections; j++)
+        {
+            struct Slice* connection = &roomText->connections[rooms[i].firstConnection + j];
+            if ((k = FindRoomIndex(world, text + connection->offset, connection->length)) == -1)
+            {
+                snprintf(error, ERROR_BUFFER, "room %s has a connection to unknown room %.*s", GetRoomName(image, i),
+                         (int) connection->length, text + connection->offset);
+                FreeWorld(world);
+                return false;
+            }
+            image->links[linkIndex++] = k;
+        }
+    }
+    image->linkOffsets[numRooms] = linkIndex;
+
+    if (image->startRoom == (uint32_t) numRooms || image->endRoom == (uint32_t) numRooms)
+    {
+        snprintf(error, ERROR_BUFFER, "there is no %s", image->startRoom == (uint32_t) numRooms ? "START_ROOM"
+                                                                                               : "END_ROOM");
+        FreeWorld(world);
+        return false;
+    }
+
+    // Checksum everything after the header and put the header in place, so the image is exactly a world.bin file.
+    SealWorldImage(image);
+    return true;
+}
+
+/* Opens the world in a rooms directory for loading its rooms on demand, keeping at most cacheSize bytes of rooms. Only
+   the START_ROOM is loaded up front. A binary world file is mapped as usual, as the kernel already reads its pages on
+   demand. Returns false with a description of the problem if the world cannot be opened. */
+bool OpenLazyWorld(struct World* world, char* dirName, size_t cacheSize, char error[])
+{
+    memset(world, 0, sizeof(struct World));
+
+    char filename[PATH_MAX];
+    snprintf(filename, sizeof(filename), "%s/%s", dirName, WORLD_FILENAME);
+    if (access(filename, F_OK) == 0)
+    {
+        return MapWorldFile(world, filename, error);
+    }
+
+    // Start with no known rooms.
+    struct RoomCache* cache = SafeRealloc(NULL, sizeof(struct RoomCache));
+    memset(cache, 0, sizeof(struct RoomCache));
+    snprintf(cache->dirName, sizeof(cache->dirName), "%s", dirName);
+    cache->capacity = cacheSize;
+    cache->roomsCapacity = PATH_CAPACITY;
+    cache->rooms = SafeRealloc(NULL, sizeof(struct CachedRoom*) * cache->roomsCapacity);
+    world->image.nameOffsets = SafeRealloc(NULL, sizeof(uint32_t) * (cache->roomsCapacity + 1));
+    world->image.nameOffsets[0] = 0;
+    world->image.types = SafeRealloc(NULL, cache->roomsCapacity);
+    world->cache = cache;
+    BuildNameIndex(world);
+
+    if (FindStartRoom(world, error) == false)
+    {
+        FreeWorld(world);
+        return false;
+    }
+    return true;
+}
+
+/* Finds and loads the START_ROOM of a world loaded on demand, from the manifest written by buildrooms or, for worlds
+   without one, by reading room files until the START_ROOM turns up. Returns false with a description of the problem
+   if there is no START_ROOM. */
+bool FindStartRoom(struct World* world, char error[])
+{
+    struct RoomCache* cache = world->cache;
+    char filename[PATH_MAX];
+    size_t size;
+    int start = -1;
+
+    // Look for the "START ROOM: name" line of the manifest.
+    if (snprintf(filename, sizeof(filename), "%s/%s", cache->dirName, MANIFEST_FILENAME) >= (int) sizeof(filename))
+    {
+        snprintf(error, ERROR_BUFFER, "%.300s: the path is too long", cache->dirName);
+        return false;
+    }
+    if (access(filename, F_OK) == 0)
+    {
+        char* manifest = ReadWholeFile(filename, &size);
+        char* line = manifest;
+        char* end = manifest + size;
+        while (line < end && start == -1)
+        {
+            char* lineEnd = memchr(line, '\n', end - line);
+            lineEnd = lineEnd == NULL ? end : lineEnd;
+            size_t length = lineEnd - line;
+            if (length > 0 && line[length-1] == '\r')
+            {
+                length--;
+            }
+            if (length > 12 && memcmp(line, "START ROOM: ", 12) == 0)
+            {
+                start = AddKnownRoom(world, line + 12, length - 12);
+            }
+            line = lineEnd + 1;
+        }
+        free(manifest);
+    }
+
+    // Otherwise read the room files in directory order until one is the START_ROOM.
+    if (start == -1)
+    {
+        DIR* dir;
+        struct dirent* dirEntry;
+        struct Room room;
+
+        if ((dir = opendir(cache->dirName)) == NULL)
+        {
+            snprintf(error, ERROR_BUFFER, "%.300s: %s", cache->dirName, strerror(errno));
+            return false;
+        }
+        while (start == -1 && (dirEntry = readdir(dir)) != NULL)
+        {
+            size_t nameLength = strlen(dirEntry->d_name);
+            if (dirEntry->d_type != DT_REG || nameLength <= 5
+                || strcmp(dirEntry->d_name + nameLength - 5, "_room") != 0)
+            {
+                continue;
+            }
+            if (snprintf(filename, sizeof(filename), "%s/%s", cache->dirName, dirEntry->d_name)
+                >= (int) sizeof(filename))
+            {
+                snprintf(error, ERROR_BUFFER, "%.300s: the path of %.100s is too long", cache->dirName,
+                         dirEntry->d_name);
+                closedir(dir);
+                return false;
+            }
+            cache->roomText.text.length = 0;
+            cache->roomText.numConnections = 0;
+            if (ReadRoomFile(filename, &room, &cache->roomText, error) == false)
+            {
+                closedir(dir);
+                return false;
+            }
+            if (room.type == START_ROOM)
+            {
+                start = AddKnownRoom(world, cache->roomText.text.data + room.name.offset, room.name.length);
+            }
+        }
+        closedir(dir);
+    }
+    if (start == -1)
+    {
+        snprintf(error, ERROR_BUFFER, "%.300s: there is no START_ROOM", cache->dirName);
+        return false;
+    }
+
+    // Load it, which also checks that it is the START_ROOM.
+    world->image.startRoom = start;
+    if (GetRoomType(world, start) != START_ROOM)
+    {
+        snprintf(error, ERROR_BUFFER, "%.300s: the manifest names %s as the START_ROOM, but it is a %s", cache->dirName,
+                 GetRoomName(&world->image, start), types[world->image.types[start]]);
+        return false;
+    }
+    return true;
+}
+
+/* Returns the index of the room with the given name in a world loaded on demand, adding it to the known rooms if it
+   is not known yet. */
+int AddKnownRoom(struct World* world, const char* name, size_t length)
+{
+    int room = FindRoomIndex(world, name, length);
+    if (room != -1)
+    {
+        return room;
+    }
+
+    // Grow the arrays of known rooms geometrically.
+    struct RoomCache* cache = world->cache;
+    struct WorldImage* image = &world->image;
+    room = image->numRooms;
+    if ((uint32_t) room == cache->roomsCapacity)
+    {
+        cache->roomsCapacity *= 2;
+        cache->rooms = SafeRealloc(cache->rooms, sizeof(struct CachedRoom*) * cache->roomsCapacity);
+        image->nameOffsets = SafeRealloc(image->nameOffsets, sizeof(uint32_t) * (cache->roomsCapacity + 1));
+        image->types = SafeRealloc(image->types, cache->roomsCapacity);
+    }
+    if (image->stringPoolSize + length + 1 > cache->poolCapacity)
+    {
+        cache->poolCapacity = (image->stringPoolSize + length + 1) * 2;
+        image->stringPool = SafeRealloc(image->stringPool, cache->poolCapacity);
+    }
+
+    // Add the name to the string pool, with the type unknown until the room is loaded.
+    memcpy(image->stringPool + image->stringPoolSize, name, length);
+    image->stringPool[image->stringPoolSize + length] = '\0';
+    image->stringPoolSize += length + 1;
+    image->nameOffsets[room+1] = image->stringPoolSize;
+    image->types[room] = UNKNOWN_TYPE;
+    cache->rooms[room] = NULL;
+    image->numRooms++;
+
+    // Keep the name index at most half full, rebuilding it with twice the slots when it fills up.
+    if (image->numRooms * 2 > world->nameIndexMask + 1)
+    {
+        free(world->nameIndex);
+        BuildNameIndex(world);
+    }
+    else
+    {
+        IndexRoomName(world, room);
+    }
+    return room;
+}
+
+/* Returns a room of a world loaded on demand, reading its room file if it is not cached, and marks it as the most
+   recently used. The least recently used rooms are evicted once the cache is over its size. The room file of a room is
+   found from its name alone, as buildrooms names it "room-name_room". Exits the program if the file cannot be read,
+   as the game cannot go on without the room. */
+struct CachedRoom* LoadCachedRoom(struct World* world, int room)
+{
+    struct RoomCache* cache = world->cache;
+    struct CachedRoom* cached = cache->rooms[room];
+
+    if (cached != NULL)
+    {
+        // Move it to the front of the list.
+        if (cached != cache->newest)
+        {
+            cached->newer->older = cached->older;
+            if (cached->older != NULL)
+                cached->older->newer = cached->newer;
+            else
+                cache->oldest = cached->newer;
+            cached->newer = NULL;
+            cached->older = cache->newest;
+            cache->newest->newer = cached;
+            cache->newest = cached;
+        }
+        return cached;
+    }
+
+    // Read the room file.
+    uint64_t start = StartTiming();
+    char filename[PATH_MAX];
+    char error[ERROR_BUFFER];
+    struct Room parsed;
+    cache->roomText.text.length = 0;
+    cache->roomText.numConnections = 0;
+    bool loaded = false;
+    if (snprintf(filename, sizeof(filename), "%s/%s_room", cache->dirName, GetRoomName(&world->image, room))
+        >= (int) sizeof(filename))
+    {
+        snprintf(error, ERROR_BUFFER, "%.300s: the path of room %.100s is too long", cache->dirName,
+                 GetRoomName(&world->image, room));
+    }
+    else
+    {
+        loaded = ReadRoomFile(filename, &parsed, &cache->roomText, error);
+    }
+    const char* text = cache->roomText.text.data;
+    if (loaded == true
+        && (parsed.name.length != GetNameLength(&world->image, room)
+            || memcmp(text + parsed.name.offset, GetRoomName(&world->image, room), parsed.name.length) != 0))
+    {
+        snprintf(error, ERROR_BUFFER, "%.300s: the room file is for room %.*s", filename, (int) parsed.name.length,
+                 text + parsed.name.offset);
+        loaded = false;
+    }
+    if (loaded == false)
+    {
+        printf("ERROR: %s\n", error);
+        exit(1);
+    }
+
+    // Resolve the connection names into room indexes, adding any rooms that are new.
+    size_t size = sizeof(struct CachedRoom) + sizeof(uint32_t) * parsed.numConnections;
+    cached = SafeRealloc(NULL, size);
+    cached->room = room;
+    cached->numConnections = parsed.numConnections;
+    int i;
+    for (i = 0; i < parsed.numConnections; i++)
+    {
+        struct Slice* connection = &cache->roomText.connections[parsed.firstConnection + i];
+        cached->connections[i] = AddKnownRoom(world, text + connection->offset, connection->length);
+    }
+    world->image.types[room] = parsed.type;
+
+    // Put it at the front of the list, then evict from the back until the cache fits, keeping the room just loaded.
+    cached->newer = NULL;
+    cached->older = cache->newest;
+    if (cache->newest != NULL)
+        cache->newest->newer = cached;
+    else
+        cache->oldest = cached;
+    cache->newest = cached;
+    cache->rooms[room] = cached;
+    cache->size += size;
+    while (cache->size > cache->capacity && cache->oldest != cached)
+    {
+        struct CachedRoom* evicted = cache->oldest;
+        cache->oldest = evicted->newer;
+        cache->oldest->older = NULL;
+        cache->rooms[evicted->room] = NULL;
+        cache->size -= sizeof(struct CachedRoom) + sizeof(uint32_t) * evicted->numConnections;
+        free(evicted);
+    }
+    StopTiming(LOAD_ROOM, start);
+
+    return cached;
+}
+
+// Returns the number of connections of a room and points connections at them, loading the room if needed.
+uint32_t GetConnections(struct World* world, int room, const uint32_t** connections)
+{
+    if (world->cache != NULL)
+    {
+        struct CachedRoom* cached = LoadCachedRoom(world, room);
+        *connections = cached->connections;
+        return cached->numConnections;
+    }
+    *connections = world->image.links + world->image.linkOffsets[room];
+    return world->image.linkOffsets[room+1] - world->image.linkOffsets[room];
+}
+
+// Returns the type of a room, loading the room if its type is not known yet.
+enum Types GetRoomType(struct World* world, int room)
+{
+    if (world->image.types[room] == UNKNOWN_TYPE)
+    {
+        LoadCachedRoom(world, room);
+    }
+    return world->image.types[room];
+}
+
+// Releases the world image.
+void FreeWorld(struct World* world)
+{
+    // A shared world is only unmapped, every part of it lives in the shared world segment.
+    if (world->shared == true)
+    {
+        DetachSharedWorld();
+        world->shared = false;
+        world->image.data = NULL;
+        world->nameIndex = NULL;
+        world->distances = NULL;
+        world->nextHops = NULL;
+        return;
+    }
+    if (world->mapped == true)
+    {
+        munmap(world->image.data, world->image.size);
+    }
+    else
+    {
+        free(world->image.data);
+    }
+    free(world->nameIndex);
+    free(world->distances);
+    free(world->nextHops);
+    if (world->cache != NULL)
+    {
+        // The known rooms live in arrays of their own rather than in one image.
+        struct CachedRoom* cached = world->cache->newest;
+        while (cached != NULL)
+        {
+            struct CachedRoom* older = cached->older;
+            free(cached);
+            cached = older;
+        }
+        free(world->cache->rooms);
+        free(world->cache->roomText.text.data);
+        free(world->cache->roomText.connections);
+        free(world->cache);
+        free(world->image.nameOffsets);
+        free(world->image.types);
+        free(world->image.stringPool);
+        world->cache = NULL;
+    }
+    world->image.data = NULL;
+    world->nameIndex = NULL;
+    world->distances = NULL;
+    world->nextHops = NULL;
+}
+
+/* Builds the hash index from room names to room indexes, using open addressing with linear probing.
+   Returns false if two rooms have the same name. */
+bool BuildNameIndex(struct World* world)
+{
+    // Use at least twice as many slots as rooms, so probe sequences stay short.
+    uint32_t numSlots = 16;
+    while (numSlots < (uint32_t) world->image.numRooms * 2)
+    {
+        numSlots *= 2;
+    }
+    world->nameIndexMask = numSlots - 1;
+    world->nameIndex = SafeRealloc(NULL, sizeof(uint32_t) * numSlots);
+    memset(world->nameIndex, 0, sizeof(uint32_t) * numSlots);
+
+    uint32_t i;
+    for (i = 0; i < world->image.numRooms; i++)
+    {
+        if (FindRoomIndex(world, GetRoomName(&world->image, i), GetNameLength(&world->image, i)) != -1)
+        {
+            return false;
+        }
+        IndexRoomName(world, i);
+    }
+
+    return true;
+}
+
+// Puts a room in the first free slot of the name index after the hash of its name.
+void IndexRoomName(struct World* world, uint32_t room)
+{
+    uint32_t slot = HashName(GetRoomName(&world->image, room), GetNameLength(&world->image, room))
+                    & world->nameIndexMask;
+    while (world->nameIndex[slot] != 0)
+    {
+        slot = (slot + 1) & world->nameIndexMask;
+    }
+    world->nameIndex[slot] = room + 1;
+}
+
+/* Builds the distance oracle with a breadth-first search backwards from the "ending room", so every step of a path
+   follows a connection the way the player can take it even where a room does not connect back. The frontier of each
+   level is a bitset. A level is expanded top-down, from each frontier room to the unvisited rooms connecting to it
+   (found through the connections turned around), while the frontier is small, and bottom-up, from each unvisited
+   room to the first of its connections in the frontier, once the frontier holds a large share of the unexplored
+   connections. */
+void BuildDistanceOracle(struct World* world)
+{
+    uint32_t numRooms = world->image.numRooms;
+    size_t numWords = (numRooms + 63) / 64;
+    uint64_t* frontier = SafeRealloc(NULL, sizeof(uint64_t) * numWords);
+    uint64_t* next = SafeRealloc(NULL, sizeof(uint64_t) * numWords);
+    uint64_t* visited = SafeRealloc(NULL, sizeof(uint64_t) * numWords);
+    memset(frontier, 0, sizeof(uint64_t) * numWords);
+    memset(visited, 0, sizeof(uint64_t) * numWords);
+    uint32_t i;
+
+    // Turn the connections around, so reverseLinks lists the rooms connecting to each room.
+    uint32_t numLinks = world->image.linkOffsets[numRooms];
+    uint32_t* reverseOffsets = SafeRealloc(NULL, sizeof(uint32_t) * (numRooms + 1));
+    uint32_t* reverseLinks = SafeRealloc(NULL, sizeof(uint32_t) * (numLinks > 0 ? numLinks : 1));
+    memset(reverseOffsets, 0, sizeof(uint32_t) * (numRooms + 1));
+    for (i = 0; i < numLinks; i++)
+    {
+        reverseOffsets[world->image.links[i] + 1]++;
+    }
+    for (i = 0; i < numRooms; i++)
+    {
+        reverseOffsets[i+1] += reverseOffsets[i];
+    }
+    uint32_t from;
+    for (from = 0; from < numRooms; from++)
+    {
+        for (i = world->image.linkOffsets[from]; i < world->image.linkOffsets[from+1]; i++)
+        {
+            reverseLinks[reverseOffsets[world->image.links[i]]++] = from;
+        }
+    }
+    // Filling each room moved its offset to the start of the next, so shift them back.
+    for (i = numRooms; i > 0; i--)
+    {
+        reverseOffsets[i] = reverseOffsets[i-1];
+    }
+    reverseOffsets[0] = 0;
+
+    // Every room starts out unreachable.
+    world->distances = SafeRealloc(NULL, sizeof(uint32_t) * numRooms);
+    world->nextHops = SafeRealloc(NULL, sizeof(uint32_t) * numRooms);
+    memset(world->distances, 0xFF, sizeof(uint32_t) * numRooms);
+    memset(world->nextHops, 0xFF, sizeof(uint32_t) * numRooms);
+
+    // Start from the "ending room".
+    uint32_t end = world->image.endRoom;
+    world->distances[end] = 0;
+    world->nextHops[end] = end;
+    frontier[end / 64] |= (uint64_t) 1 << (end % 64);
+    visited[end / 64] |= (uint64_t) 1 << (end % 64);
+
+    uint64_t frontierLinks = reverseOffsets[end + 1] - reverseOffsets[end];
+    uint64_t unexploredLinks = numLinks - frontierLinks;
+    uint32_t distance = 0;
+    size_t w;
+
+    while (frontierLinks > 0)
+    {
+        distance++;
+        memset(next, 0, sizeof(uint64_t) * numWords);
+        uint64_t nextLinks = 0;
+
+        if (frontierLinks * 14 > unexploredLinks)
+        {
+            // Bottom-up: every unvisited room looks for a connection in the frontier.
+            for (w = 0; w < numWords; w++)
+            {
+                uint64_t bits = ~visited[w];
+                if (w == numWords - 1 && numRooms % 64 != 0)
+                {
+                    bits &= ((uint64_t) 1 << (numRooms % 64)) - 1;
+                }
+                while (bits != 0)
+                {
+                    uint32_t room = w * 64 + __builtin_ctzll(bits);
+                    bits &= bits - 1;
+                    for (i = world->image.linkOffsets[room]; i < world->image.linkOffsets[room+1]; i++)
+                    {
+                        uint32_t other = world->image.links[i];
+                        if (frontier[other / 64] & ((uint64_t) 1 << (other % 64)))
+                        {
+                            world->distances[room] = distance;
+                            world->nextHops[room] = other;
+                            next[w] |= (uint64_t) 1 << (room % 64);
+                            nextLinks += reverseOffsets[room+1] - reverseOffsets[room];
+                            break;
+                        }
+                    }
+                }
+            }
+            for (w = 0; w < numWords; w++)
+            {
+                visited[w] |= next[w];
+            }
+        }
+        else
+        {
+            // Top-down: every frontier room visits the unvisited rooms connecting to it.
+            for (w = 0; w < numWords; w++)
+            {
+                uint64_t bits = frontier[w];
+                while (bits != 0)
+                {
+                    uint32_t room = w * 64 + __builtin_ctzll(bits);
+                    bits &= bits - 1;
+                    for (i = reverseOffsets[room]; i < reverseOffsets[room+1]; i++)
+                    {
+                        uint32_t other = reverseLinks[i];
+                        uint64_t bit = (uint64_t) 1 << (other % 64);
+                        if ((visited[other / 64] & bit) == 0)
+                        {
+                            visited[other / 64] |= bit;
+                            next[other / 64] |= bit;
+                            world->distances[other] = distance;
+                            world->nextHops[other] = room;
+                            nextLinks += reverseOffsets[other+1] - reverseOffsets[other];
+                        }
+                    }
+                }
+            }
+        }
+
+        // The next level becomes the frontier.
+        uint64_t* swap = frontier;
+        frontier = next;
+        next = swap;
+        unexploredLinks -= nextLinks;
+        frontierLinks = nextLinks;
+    }
+
+    free(frontier);
+    free(next);
+    free(visited);
+    free(reverseOffsets);
+    free(reverseLinks);
+}
+
+// Returns the FNV-1a hash of a room name.
+uint32_t HashName(const char* name, size_t length)
+{
+    uint32_t hash = 2166136261U;
+    size_t i;
+    for (i = 0; i < length; i++)
+    {
+        hash ^= (unsigned char) name[i];
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+// Returns the index of the room with the given name (which need not be null-terminated), or -1 if there is none.
+int FindRoomIndex(struct World* world, const char* roomName, size_t length)
+{
+    uint32_t slot = HashName(roomName, length) & world->nameIndexMask;
+
+    // Follow the probe sequence until the name or an empty slot is found.
+    while (world->nameIndex[slot] != 0)
+    {
+        int index = world->nameIndex[slot] - 1;
+        if (GetNameLength(&world->image, index) == length
+            && memcmp(GetRoomName(&world->image, index), roomName, length) == 0)
+        {
+            return index;
+        }
+        slot = (slot + 1) & world->nameIndexMask;
+    }
+    return -1;
+}
+
+/* Reallocates memory (or allocates it if ptr is NULL), exiting the program if the allocation fails. While the
+   benchmarks run, every call is counted (see bench.h). */
+void* SafeRealloc(void* ptr, size_t size)
+{
+    CountAllocation(size);
+    void* newPtr = realloc(ptr, size);
+    if (newPtr == NULL && size > 0)
+    {
+        printf("ERROR: Failed to allocate %lu bytes\n", (unsigned long) size);
+        perror("In SafeRealloc()");
+        exit(1);
+    }
+    return newPtr;
+}
+
+// Puts the name of the most recently created rooms directory in dirName, which holds PATH_MAX characters.
+void GetMostRecentDir(char dirName[])
+{
+    // Directory variables.
+    DIR* dir;
+    int statRet = 0;
+    struct stat dirStat;
+    struct dirent* dirEntry;
+    time_t mostRecentTime = 0;
+
+    /* Follow the latest link when it points to a rooms directory, without looking at any other entry. A target that
+       fills the whole buffer may have been cut short, so it is an error rather than a reason to scan instead. */
+    ssize_t linkLength = readlink(LATEST_LINK, dirName, PATH_MAX - 1);
+    if (linkLength == PATH_MAX - 1)
+    {
+        printf("ERROR: The target of \"%s\" is too long\n", LATEST_LINK);
+        exit(1);
+    }
+    if (linkLength > 0)
+    {
+        dirName[linkLength] = '\0';
+        if (stat(dirName, &dirStat) == 0 && S_ISDIR(dirStat.st_mode))
+        {
+            return;
+        }
+        memset(dirName, '\0', PATH_MAX);
+    }
+
+    // Otherwise open the current directory and look for the newest rooms directory.
+    if ((dir = opendir(".")) == NULL)
+    {
+        printf("ERROR: Failed to open the current directory\n");
+        perror("In GetMostRecentDir() with opendir()");
+        exit(1);
+    }
+
+    // Loop through all the files in the current directory.
+    while ((dirEntry = readdir(dir)) != NULL)
+    {
+        // (Re)Initialize stat buffer.
+        memset(&dirStat, 0, sizeof(dirStat));
+
+        // Get stats of current directory entry.
+        statRet = stat(dirEntry->d_name, &dirStat);
+
+        // Skip entries that vanished or cannot be read, they cannot be the rooms directory to load.
+        if (statRet != 0)
+        {
+            continue;
+        } // If the file path type is a directory that starts with "rooms." (not a world buildrooms is still writing).
+        else if (S_ISDIR(dirStat.st_mode) && strncmp(dirEntry->d_name, "rooms.", 6) == 0)
+        {
+            // Compare its modified time value to find the most recent time.
+            if (dirStat.st_mtime > mostRecentTime)
+            {
+                // Get the directory name and update the modified time comparison variable.
+                memset(dirName, '\0', PATH_MAX);
+                strcpy(dirName, dirEntry->d_name);
+                mostRecentTime = dirStat.st_mtime;
+            }
+        } // If the file path was not a rooms directory, simply loop again to the next file.
+    }
+
+    if ((strlen(dirName)) == 0)
+    {
+        printf("ERROR: There is no rooms directory in the current directory.\n");
+        perror("In GetMostRecentDir()");
+        exit(1);
+    }
+
+    // Close the directory.
+    closedir(dir);
+    
+    //return dirName;
+}
+
+// World claimed from the pool by this game, removed by ReleasePoolWorld() when the program exits, or empty.
+char claimedDir[STR_BUFFER] = "";
+
+/* Claims a world from the pool that buildrooms -P keeps full, by renaming one of its ready rooms.* worlds to
+   claimed.PID. A rename succeeds for one game only, so games starting together always get different worlds, and a
+   game that loses the race for a world moves on to the next one. The claimed world is removed when the program
+   exits (the pool generator removes it instead if the game is killed). Returns false if no world is ready. */
+bool ClaimPoolWorld(char dirName[])
+{
+    DIR* dir;
+    struct dirent* dirEntry;
+    char path[PATH_MAX];
+
+    // Remove a world left claimed under this process id by an earlier game that died, as it would block the rename.
+    snprintf(claimedDir, sizeof(claimedDir), "%s/%s%d", POOL_DIRNAME, CLAIMED_PREFIX, (int) getpid());
+    ReleasePoolWorld();
+
+    if ((dir = opendir(POOL_DIRNAME)) != NULL)
+    {
+        while ((dirEntry = readdir(dir)) != NULL)
+        {
+            snprintf(path, sizeof(path), "%s/%s", POOL_DIRNAME, dirEntry->d_name);
+            if (strncmp(dirEntry->d_name, "rooms.", 6) == 0 && rename(path, claimedDir) == 0)
+            {
+                closedir(dir);
+                strcpy(dirName, claimedDir);
+                atexit(ReleasePoolWorld);
+                return true;
+            }
+        }
+        closedir(dir);
+    }
+
+    claimedDir[0] = '\0';
+    return false;
+}
+
+// Removes the world claimed from the pool, and the files inside it, once its game is over.
+void ReleasePoolWorld(void)
+{
+    DIR* dir;
+    struct dirent* dirEntry;
+    char path[PATH_MAX];
+
+    if (claimedDir[0] == '\0' || (dir = opendir(claimedDir)) == NULL)
+    {
+        return;
+    }
+    while ((dirEntry = readdir(dir)) != NULL)
+    {
+        if (strcmp(dirEntry->d_name, ".") != 0 && strcmp(dirEntry->d_name, "..") != 0)
+        {
+            snprintf(path, sizeof(path), "%s/%s", claimedDir, dirEntry->d_name);
+            unlink(path);
+        }
+    }
+    closedir(dir);
+    rmdir(claimedDir);
+}
+
+// Takes the index of a room and displays the details of the room.
+void DisplayRoom(struct World* world, int index, struct Buffer* out)
+{
+    AppendFormat(out, "CURRENT ROOM: %s\n", GetRoomName(&world->image, index));
+    AppendFormat(out, "POSSIBLE CONNECTIONS: ");
+    const uint32_t* connections;
+    uint32_t numConnections = GetConnections(world, index, &connections);
+    uint32_t i;
+    for(i = 0; i + 1 < numConnections; i++)
+    {
+        AppendFormat(out, "%s, ", GetRoomName(&world->image, connections[i]));
+    }
+    AppendFormat(out, "%s.\n", numConnections > 0 ? GetRoomName(&world->image, connections[i]) : "");
+}
+
+// Appends text to a buffer, growing it as needed.
+void AppendText(struct Buffer* buffer, const char* text, size_t length)
+{
+    if (buffer->length + length > buffer->capacity)
+    {
+        buffer->capacity = (buffer->length + length) * 2;
+        buffer->data = SafeRealloc(buffer->data, buffer->capacity);
+    }
+    memcpy(buffer->data + buffer->length, text, length);
+    buffer->length += length;
+}
+
+// Appends printf() formatted text to a buffer.
+void AppendFormat(struct Buffer* buffer, const char* format, ...)
+{
+    char text[STR_BUFFER*2];
+    va_list args;
+
+    va_start(args, format);
+    int length = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+
+    if (length > 0)
+    {
+        AppendText(buffer, text, (size_t) length < sizeof(text) ? (size_t) length : sizeof(text) - 1);
+    }
+}
+
+// Writes a buffer to the screen and empties it.
+void FlushBuffer(struct Buffer* buffer)
+{
+    uint64_t start = StartTiming();
+    fwrite(buffer->data, 1, buffer->length, stdout);
+    fflush(stdout);
+    buffer->length = 0;
+    StopTiming(WRITE_OUTPUT, start);
+}
+
+// Writes the current room and the prompt or, if the player is in the "ending room", the end of game messages.
+void WritePrompt(struct World* world, struct Session* session, struct Buffer* out)
+{
+    if (GetRoomType(world, session->currentRoom) == END_ROOM)
+    {
+        // Print a congratulatory message, the number of steps the player took, and the path the player took.
+        AppendFormat(out, "YOU HAVE FOUND THE END ROOM. CONGRATULATIONS!");
+        if (world->distances != NULL)
+        {
+            AppendFormat(out, "\nYOU TOOK %d STEPS (THE SHORTEST PATH TAKES %u). YOUR PATH TO VICTORY WAS:\n",
+                         session->steps, world->distances[world->image.startRoom]);
+        }
+        else
+        {
+            AppendFormat(out, "\nYOU TOOK %d STEPS. YOUR PATH TO VICTORY WAS:\n", session->steps);
+        }
+        PrintPlayerPath(world, &session->path, out);
+    }
+    else
+    {
+        DisplayRoom(world, session->currentRoom, out);
+        AppendFormat(out, "WHERE TO? >");
+    }
+}
+
+// Writes the reply to a processed command, followed by the next prompt.
+void WriteResponse(struct World* world, struct Session* session, enum Results result, char strTime[],
+                   struct Buffer* out)
+{
+    switch (result)
+    {
+        case TIME_SHOWN:
+            // If the user typed "time", display the time provided by the second thread.
+            DisplayTime(strTime, out);
+            break;
+        case PATH_SHOWN:
+            AppendFormat(out, "\nYOUR PATH SO FAR:\n");
+            PrintPlayerPath(world, &session->path, out);
+            AppendFormat(out, "\n");
+            break;
+        case HINT_SHOWN:
+            // Name the connection that is one step closer to the "ending room".
+            if (world->distances == NULL)
+            {
+                AppendFormat(out, "\nNO HINTS ARE AVAILABLE WHILE ROOMS ARE LOADED ON DEMAND.\n\n");
+            }
+            else if (world->distances[session->currentRoom] == UNREACHABLE)
+            {
+                AppendFormat(out, "\nTHERE IS NO WAY TO THE END ROOM FROM HERE.\n\n");
+            }
+            else
+            {
+                AppendFormat(out, "\nHINT: GO TO %s. THE END ROOM IS %u STEPS AWAY.\n\n",
+                             GetRoomName(&world->image, world->nextHops[session->currentRoom]),
+                             world->distances[session->currentRoom]);
+            }
+            break;
+        case ROOM_INVALID:
+            // If the user choice was invalid, display an error message and loop again.
+            AppendFormat(out, "\nHUH? I DON'T UNDERSTAND THAT ROOM. TRY AGAIN\n\n");
+            break;
+        case ROOM_ENTERED:
+            AppendFormat(out, "\n"); // To match the formatting of the example.
+            break;
+    }
+    WritePrompt(world, session, out);
+}
+
+/* Checks if the user choice was a valid connection for the current room, and if so returns the new room index.
+   Returns -1 if the user choice was not a valid connection. */
+int GetSelectedRoomIndex(struct World* world, int currentRoomIndex, char* roomName)
+{
+    // Look up the index of the named room.
+    int selectedRoomIndex = FindRoomIndex(world, roomName, strlen(roomName));
+    if (selectedRoomIndex == -1)
+    {
+        return -1;
+    }
+
+    // Check that it is one of the connections of the current room.
+    const uint32_t* connections;
+    uint32_t numConnections = GetConnections(world, currentRoomIndex, &connections);
+    uint32_t i;
+    for (i = 0; i < numConnections; i++)
+    {
+        if (connections[i] == (uint32_t) selectedRoomIndex)
+        {
+            return selectedRoomIndex;
+        }
+    }
+
+    // If the loop did not exit early, then the user choice was not a valid connection so return -1;
+    return -1;
+}
+
+// Initializes a session in the starting room of the world.
+void InitSession(struct Session* session, struct World* world, size_t spillLimit)
+{
+    session->currentRoom = world->image.startRoom;
+    session->steps = 0;
+    InitPath(&session->path, spillLimit);
+    CountStat(GAMES_COUNTER);
+}
+
+// Frees the memory held by a session.
+void FreeSession(struct Session* session)
+{
+    FreePath(&session->path);
+}
+
+/* Sets up the checkpoint of a game of a world, to be saved to a file. The world is identified by the checksum in the
+   header of its image, which covers every room, name and connection. */
+void InitCheckpoint(struct Checkpoint* checkpoint, struct World* world, char* filename)
+{
+    struct WorldHeader worldHeader;
+
+    memcpy(&worldHeader, world->image.data, sizeof(worldHeader));
+    checkpoint->filename = filename;
+    snprintf(checkpoint->tmpFilename, sizeof(checkpoint->tmpFilename), "%s.tmp", filename);
+    checkpoint->fd = -1;
+    checkpoint->worldId = worldHeader.checksum;
+    checkpoint->numRooms = world->image.numRooms;
+    checkpoint->lastRoom = world->image.startRoom;
+    checkpoint->pathRooms = 0;
+    checkpoint->chain = 0;
+}
+
+/* Resumes a game from its checkpoint file: the current room and steps are restored as saved, and the path is decoded
+   straight into the session, without playing any move again. A move cut short by a crash (or otherwise damaged) is
+   cut off the end of the file, with every move before it kept. Returns false, leaving the session as it is, if there
+   is no checkpoint, or it is damaged or belongs to another world (with a warning on stderr). */
+bool ResumeCheckpoint(struct Checkpoint* checkpoint, struct World* world, struct Session* session)
+{
+    struct CheckpointHeader header;
+    size_t size;
+
+    if (access(checkpoint->filename, F_OK) != 0)
+    {
+        return false;
+    }
+    uint64_t start = StartTiming();
+    char* data = ReadWholeFile(checkpoint->filename, &size);
+
+    // Check the header and its checksum before trusting any of it.
+    size_t checked = offsetof(struct CheckpointHeader, version);
+    char* problem = NULL;
+    if (size < sizeof(header))
+    {
+        problem = "file is too small";
+    }
+    else
+    {
+        memcpy(&header, data, sizeof(header));
+        if (memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) != 0 || header.version != CHECKPOINT_VERSION
+            || Checksum((unsigned char*) data + checked, sizeof(header) - checked) != header.checksum)
+        {
+            problem = "not a valid checkpoint";
+        }
+        else if (header.worldId != checkpoint->worldId || header.numRooms != checkpoint->numRooms)
+        {
+            problem = "saved from another world";
+        }
+    }
+    if (problem != NULL)
+    {
+        fprintf(stderr, "WARNING: Not resuming from %s: %s, starting a new game.\n", checkpoint->filename, problem);
+        free(data);
+        return false;
+    }
+
+    /* Decode the moves: each is a varint of the zigzag encoded difference of its room from the room before it, then
+       the low 4 bytes of the chain, which only match if this move and every move before it were written whole. */
+    unsigned char* moves = (unsigned char*) data;
+    size_t position = sizeof(header);
+    uint64_t chain = header.checksum;
+    uint32_t room = world->image.startRoom;
+    uint32_t* rooms = SafeRealloc(NULL, sizeof(uint32_t) * ((size - position) / 5 + 1));
+    uint64_t pathRooms = 0;
+    while (position < size)
+    {
+        size_t length = 0;
+        while (length < 10 && position + length < size && (moves[position + length] & 0x80) != 0)
+        {
+            length++;
+        }
+        if (length == 10 || position + length + 1 + sizeof(uint32_t) > size)
+        {
+            break;
+        }
+        length++;
+        uint64_t nextChain = ChainCheckpoint(chain, moves + position, length);
+        uint32_t tag;
+        memcpy(&tag, moves + position + length, sizeof(tag));
+        if (tag != (uint32_t) nextChain)
+        {
+            break;
+        }
+
+        uint64_t value = 0;
+        size_t i;
+        for (i = 0; i < length; i++)
+        {
+            value |= (uint64_t) (moves[position + i] & 0x7F) << (7 * i);
+        }
+        int64_t next = (int64_t) room + (int64_t) ((value >> 1) ^ (0 - (value & 1)));
+        if (next < 0 || next >= header.numRooms)
+        {
+            break;
+        }
+        room = next;
+        rooms[pathRooms++] = room;
+        chain = nextChain;
+        position += length + sizeof(tag);
+    }
+
+    // Append the next moves to the checkpoint, after the last move that was written whole.
+    if ((checkpoint->fd = open(checkpoint->filename, O_WRONLY | O_APPEND)) == -1
+        || (position < size && (ftruncate(checkpoint->fd, position) != 0 || fdatasync(checkpoint->fd) != 0)))
+    {
+        printf("ERROR: Failed to open the checkpoint \"%s\"\n", checkpoint->filename);
+        perror("In ResumeCheckpoint()");
+        exit(1);
+    }
+    if (position < size)
+    {
+        fprintf(stderr, "WARNING: Dropped %zu damaged bytes at the end of %s, resuming from the move before them.\n",
+                size - position, checkpoint->filename);
+    }
+
+    // Pick up where the game left off.
+    session->currentRoom = room;
+    session->steps = pathRooms;
+    uint64_t i;
+    for (i = 0; i < pathRooms; i++)
+    {
+        RecordValidChoice(&session->path, rooms[i]);
+    }
+    checkpoint->lastRoom = room;
+    checkpoint->pathRooms = pathRooms;
+    checkpoint->chain = chain;
+
+    free(rooms);
+    free(data);
+    StopTiming(RESUME_GAME, start);
+    return true;
+}
+
+/* Starts a new checkpoint file holding just its header. The header is written to a file of its own, flushed to disk
+   and renamed over any old checkpoint, and the rename flushed too, so that even after a power loss the checkpoint
+   file is either the old checkpoint or the new one. */
+void StartCheckpoint(struct Checkpoint* checkpoint)
+{
+    struct CheckpointHeader header;
+    uint64_t start = StartTiming();
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.version = CHECKPOINT_VERSION;
+    header.numRooms = checkpoint->numRooms;
+    header.worldId = checkpoint->worldId;
+    size_t checked = offsetof(struct CheckpointHeader, version);
+    header.checksum = Checksum((unsigned char*) &header + checked, sizeof(header) - checked);
+
+    int fd;
+    if ((fd = open(checkpoint->tmpFilename, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1
+        || write(fd, &header, sizeof(header)) != sizeof(header) || fdatasync(fd) != 0 || close(fd) != 0
+        || rename(checkpoint->tmpFilename, checkpoint->filename) != 0)
+    {
+        printf("ERROR: Failed to save the checkpoint \"%s\"\n", checkpoint->filename);
+        perror("In StartCheckpoint()");
+        exit(1);
+    }
+
+    // Flush the rename, in the directory holding the checkpoint.
+    char dirName[PATH_MAX];
+    snprintf(dirName, sizeof(dirName), "%s", checkpoint->filename);
+    char* slash = strrchr(dirName, '/');
+    if (slash == NULL)
+    {
+        strcpy(dirName, ".");
+    }
+    else
+    {
+        slash[slash == dirName ? 1 : 0] = '\0';
+    }
+    SyncDir(dirName);
+
+    if ((checkpoint->fd = open(checkpoint->filename, O_WRONLY | O_APPEND)) == -1)
+    {
+        printf("ERROR: Failed to open the checkpoint \"%s\"\n", checkpoint->filename);
+        perror("In StartCheckpoint()");
+        exit(1);
+    }
+    checkpoint->chain = header.checksum;
+    StopTiming(SAVE_CHECKPOINT, start);
+}
+
+/* Saves a room entered by the player by appending it to the checkpoint file, and flushing it to disk before the
+   game goes on. A move costs one write of 5 to 7 bytes (for rooms near the room before them) however long the
+   path is. A crash in the middle of the write leaves a move whose chain does not match, which is dropped when the
+   game is resumed. */
+void AppendCheckpointRoom(struct Checkpoint* checkpoint, uint32_t room)
+{
+    uint64_t start = StartTiming();
+
+    // Rooms are mostly near the room before them, so store the difference, zigzag encoded to be small either way.
+    int64_t difference = (int64_t) room - (int64_t) checkpoint->lastRoom;
+    uint64_t value = ((uint64_t) difference << 1) ^ (uint64_t) (difference >> 63);
+
+    // Then as a varint: 7 bits per byte, lowest first, with the top bit set on every byte but the last.
+    unsigned char bytes[10 + sizeof(uint32_t)];
+    size_t length = 0;
+    while (value >= 0x80)
+    {
+        bytes[length++] = (unsigned char) ((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    bytes[length++] = (unsigned char) value;
+
+    // Then the low 4 bytes of the chain, which covers the header and every move.
+    uint64_t chain = ChainCheckpoint(checkpoint->chain, bytes, length);
+    uint32_t tag = (uint32_t) chain;
+    memcpy(bytes + length, &tag, sizeof(tag));
+    length += sizeof(tag);
+
+    size_t written = 0;
+    while (written < length)
+    {
+        ssize_t numWritten = write(checkpoint->fd, bytes + written, length - written);
+        if (numWritten < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (numWritten <= 0)
+        {
+            break;
+        }
+        written += numWritten;
+    }
+    if (written < length || fdatasync(checkpoint->fd) != 0)
+    {
+        printf("ERROR: Failed to save the checkpoint \"%s\"\n", checkpoint->filename);
+        perror("In AppendCheckpointRoom()");
+        exit(1);
+    }
+
+    checkpoint->lastRoom = room;
+    checkpoint->pathRooms++;
+    checkpoint->chain = chain;
+    StopTiming(SAVE_CHECKPOINT, start);
+}
+
+// Returns the chain of a checkpoint after a move: the checksum of the chain before it and the bytes of the move.
+uint64_t ChainCheckpoint(uint64_t chain, const unsigned char* bytes, size_t length)
+{
+    unsigned char link[sizeof(uint64_t) + 10];
+    memcpy(link, &chain, sizeof(chain));
+    memcpy(link + sizeof(chain), bytes, length);
+    return Checksum(link, sizeof(chain) + length);
+}
+
+// Closes the checkpoint file.
+void FreeCheckpoint(struct Checkpoint* checkpoint)
+{
+    if (checkpoint->fd != -1)
+    {
+        close(checkpoint->fd);
+        checkpoint->fd = -1;
+    }
+}
+
+// Processes one command typed by the player, timing it by its result when timing is on.
+enum Results ProcessCommand(struct World* world, struct TimeService* timeService, struct Session* session,
+                            char* command, char strTime[])
+{
+    uint64_t start = StartTiming();
+    enum Results result = ExecuteCommand(world, timeService, session, command, strTime);
+    StopTiming(commandMetrics[result], start);
+    CountStat(COMMANDS_COUNTER);
+    CountStat(commandCounters[result]);
+    if (result == ROOM_ENTERED && GetRoomType(world, session->currentRoom) == END_ROOM)
+    {
+        CountStat(WINS_COUNTER);
+    }
+    return result;
+}
+
+/* Executes one command typed by the player: "time", which copies the current time into strTime, "path", "hint", or
+   the name of a room connected to the current room, which moves the player there. */
+enum Results ExecuteCommand(struct World* world, struct TimeService* timeService, struct Session* session,
+                            char* command, char strTime[])
+{
+    if (strcmp(command, "time") == 0)
+    {
+        GetTime(timeService, strTime);
+        return TIME_SHOWN;
+    }
+    if (strcmp(command, "path") == 0)
+    {
+        return PATH_SHOWN;
+    }
+    if (strcmp(command, "hint") == 0)
+    {
+        return HINT_SHOWN;
+    }
+
+    // Otherwise, try to get the user choice.
+    int selectedRoomIndex = GetSelectedRoomIndex(world, session->currentRoom, command);
+    if (selectedRoomIndex == -1)
+    {
+        // If the user choice was invalid, don't increment the steps.
+        return ROOM_INVALID;
+    }
+    else if (selectedRoomIndex >= (int) world->image.numRooms || selectedRoomIndex < -1)
+    {
+        // Error handling.
+        printf("ERROR: Something went wrong trying to get the selected room index %d\n", selectedRoomIndex);
+        perror("In ExecuteCommand() with GetSelectedRoomIndex()");
+        exit(1);
+    }
+
+    // Otherwise, if the user choice was valid, move to the selected room, record the valid user choice
+    // and increment the step count
+    session->currentRoom = selectedRoomIndex;
+    RecordValidChoice(&session->path, selectedRoomIndex);
+    session->steps++;
+    return ROOM_ENTERED;
+}
+
+// Plays an interactive game, prompting the user until the "ending room" is reached.
+void PlayGame(struct World* world, struct TimeService* timeService, struct Options* options)
+{
+    // Variables to get the user choice.
+    char* userChoice = NULL;
+    size_t userChoiceBuffer = 0;
+    char strTime[STR_BUFFER];
+    struct Buffer out = {NULL, 0, 0};
+
+    // Variables to keep track of player stats such as steps and path taken.
+    struct Session session;
+    InitSession(&session, world, options->spillLimit);
+
+    // Resume the game saved in the checkpoint file, if there is one for this world, and save it after every move.
+    struct Checkpoint checkpoint;
+    if (options->checkpointFilename != NULL)
+    {
+        InitCheckpoint(&checkpoint, world, options->checkpointFilename);
+        if (ResumeCheckpoint(&checkpoint, world, &session) == true)
+        {
+            AppendFormat(&out, "RESUMING YOUR GAME AFTER %d STEPS.\n\n", session.steps);
+        }
+        else
+        {
+            StartCheckpoint(&checkpoint);
+        }
+    }
+
+    // Open the record file if the commands are being recorded.
+    FILE* recordFile = NULL;
+    if (options->recordFilename != NULL && (recordFile = fopen(options->recordFilename, "w")) == NULL)
+    {
+        printf("ERROR: Failed to open filename \"%s\"\n", options->recordFilename);
+        perror("In PlayGame()");
+        exit(1);
+    }
+
+    // Display the starting room.
+    WritePrompt(world, &session, &out);
+    FlushBuffer(&out);
+
+    // Start the game.
+    while (GetRoomType(world, session.currentRoom) != END_ROOM)
+    {
+        // Get the input and remove the newline character.
+        if (getline(&userChoice, &userChoiceBuffer, stdin) == -1)
+        {
+            // The input ended before the game did.
+            printf("\n");
+            exit(1);
+        }
+        userChoice[strcspn(userChoice, "\n")] = '\0';
+        if (recordFile != NULL)
+        {
+            fprintf(recordFile, "%s\n", userChoice);
+        }
+
+        // Process user choice, then display the result and the next prompt (or the end of game messages).
+        enum Results result = ProcessCommand(world, timeService, &session, userChoice, strTime);
+        if (result == ROOM_ENTERED && options->checkpointFilename != NULL)
+        {
+            AppendCheckpointRoom(&checkpoint, session.currentRoom);
+        }
+        WriteResponse(world, &session, result, strTime, &out);
+        FlushBuffer(&out);
+    } // End of game loop.
+
+    // A finished game has nothing to resume.
+    if (options->checkpointFilename != NULL)
+    {
+        unlink(options->checkpointFilename);
+        FreeCheckpoint(&checkpoint);
+    }
+
+    // Deallocate memory for user choice.
+    free(userChoice);
+    userChoice = NULL;
+    free(out.data);
+    if (recordFile != NULL)
+    {
+        fclose(recordFile);
+    }
+
+    // Release the session.
+    FreeSession(&session);
+}
+
+/* Plays each script against the world without prompts and prints one tab-separated result line per script, then a
+   summary. Returns 0 if every script reached the "ending room", and 1 otherwise. */
+int RunScripts(struct World* world, struct TimeService* timeService, struct Options* options, char* scripts[],
+               int numScripts)
+{
+    int i;
+    int numWon = 0;
+    char strTime[STR_BUFFER];
+    struct timespec runStart, gameStart;
+
+    clock_gettime(CLOCK_MONOTONIC, &runStart);
+    printf("script\toutcome\tsteps\tshortest\tcommands\tinvalid\tmicroseconds\n");
+
+    for (i = 0; i < numScripts; i++)
+    {
+        // Read the whole script, then split it into commands in place.
+        size_t size;
+        char* script = ReadWholeFile(scripts[i], &size);
+        char* command = script;
+        char* end = script + size;
+        int numCommands = 0;
+        int numInvalid = 0;
+
+        clock_gettime(CLOCK_MONOTONIC, &gameStart);
+        struct Session session;
+        InitSession(&session, world, options->spillLimit);
+
+        while (command < end && GetRoomType(world, session.currentRoom) != END_ROOM)
+        {
+            // Terminate the command at the end of its line, dropping any carriage return.
+            char* newline = memchr(command, '\n', end - command);
+            char* next = newline != NULL ? newline + 1 : end;
+            if (newline == NULL)
+            {
+                newline = end;
+            }
+            if (newline > command && newline[-1] == '\r')
+            {
+                newline--;
+            }
+            *newline = '\0';
+
+            numCommands++;
+            if (ProcessCommand(world, timeService, &session, command, strTime) == ROOM_INVALID)
+            {
+                numInvalid++;
+            }
+            command = next;
+        }
+
+        bool won = GetRoomType(world, session.currentRoom) == END_ROOM;
+        if (won == true)
+        {
+            numWon++;
+        }
+
+        // The shortest path is only known if the distance oracle was built.
+        char shortest[STR_BUFFER] = "-";
+        if (world->distances != NULL)
+        {
+            snprintf(shortest, sizeof(shortest), "%u", world->distances[world->image.startRoom]);
+        }
+        printf("%s\t%s\t%d\t%s\t%d\t%d\t%.0f\n", scripts[i], won == true ? "WON" : "UNFINISHED", session.steps,
+               shortest, numCommands, numInvalid, ElapsedSeconds(&gameStart) * 1e6);
+
+        FreeSession(&session);
+        free(script);
+    }
+
+    double seconds = ElapsedSeconds(&runStart);
+    printf("# %d scripts, %d won, %.3f seconds, %.0f scripts per second\n", numScripts, numWon, seconds,
+           seconds > 0 ? numScripts / seconds : 0);
+
+    return numWon == numScripts ? 0 : 1;
+}
+
+/* Checks the worlds in the given paths across a pool of threads and reports every problem found, without stopping
+   at the first one. A path named rooms.* is checked as a world, any other directory is searched for rooms.*
+   directories. Returns 0 if every world is valid, and 1 otherwise. */
+int RunValidator(struct Options* options, char* paths[], int numPaths)
+{
+    struct Validator validator;
+    struct timespec start;
+    int i, capacity = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // Find the worlds to check, in the current directory if no path is given.
+    char* currentDir = ".";
+    if (numPaths == 0)
+    {
+        paths = &currentDir;
+        numPaths = 1;
+    }
+    validator.options = options;
+    validator.dirs = NULL;
+    validator.numDirs = 0;
+    for (i = 0; i < numPaths; i++)
+    {
+        CollectWorldDirs(&validator, paths[i], true, &capacity);
+    }
+
+    // Check them across the threads.
+    validator.nextDir = 0;
+    validator.numInvalid = 0;
+    pthread_mutex_init(&validator.outputMutex, NULL);
+    pthread_t* threads = SafeRealloc(NULL, sizeof(pthread_t) * options->numWorkers);
+    for (i = 0; i < options->numWorkers; i++)
+    {
+        if (pthread_create(&threads[i], NULL, ValidateWorlds, &validator) != 0)
+        {
+            printf("ERROR: There was a problem creating a thread\n");
+            perror("In RunValidator() with pthread_create()");
+            exit(1);
+        }
+    }
+    for (i = 0; i < options->numWorkers; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_mutex_destroy(&validator.outputMutex);
+
+    printf("# %d worlds, %d valid, %d invalid, %.3f seconds\n", validator.numDirs,
+           validator.numDirs - validator.numInvalid, validator.numInvalid, ElapsedSeconds(&start));
+
+    for (i = 0; i < validator.numDirs; i++)
+    {
+        free(validator.dirs[i]);
+    }
+    free(validator.dirs);
+    free(threads);
+
+    return validator.numInvalid == 0 ? 0 : 1;
+}
+
+/* Adds the rooms directories under a path to the worlds to check. A path given on the command line that holds no
+   rooms.* directories is checked as a world itself, whatever its name. */
+void CollectWorldDirs(struct Validator* validator, char* path, bool explicit, int* capacity)
+{
+    DIR* dir;
+    struct dirent* dirEntry;
+    struct stat dirStat;
+    char childPath[PATH_MAX];
+    int numDirs = validator->numDirs;
+
+    // Check a rooms directory as a world.
+    char* name = strrchr(path, '/');
+    name = name != NULL ? name + 1 : path;
+    if (strncmp(name, "rooms.", 6) != 0 && (dir = opendir(path)) != NULL)
+    {
+        // Search any other directory, skipping links such as rooms.latest so no world is checked twice.
+        while ((dirEntry = readdir(dir)) != NULL)
+        {
+            if (strcmp(dirEntry->d_name, ".") == 0 || strcmp(dirEntry->d_name, "..") == 0)
+            {
+                continue;
+            }
+            snprintf(childPath, sizeof(childPath), "%s/%s", path, dirEntry->d_name);
+            if (lstat(childPath, &dirStat) == 0 && S_ISDIR(dirStat.st_mode))
+            {
+                CollectWorldDirs(validator, childPath, false, capacity);
+            }
+        }
+        closedir(dir);
+
+        if (explicit == false || validator->numDirs > numDirs)
+        {
+            return;
+        }
+    }
+
+    if (validator->numDirs == *capacity)
+    {
+        *capacity = *capacity == 0 ? 64 : *capacity * 2;
+        validator->dirs = SafeRealloc(validator->dirs, sizeof(char*) * *capacity);
+    }
+    validator->dirs[validator->numDirs] = SafeRealloc(NULL, strlen(path) + 1);
+    strcpy(validator->dirs[validator->numDirs], path);
+    validator->numDirs++;
+}
+
+// Runs in each thread of the validator, checking worlds until every directory has been taken.
+void* ValidateWorlds(void* arg)
+{
+    struct Validator* validator = arg;
+    struct Buffer report = {NULL, 0, 0};
+    struct World world;
+    char error[ERROR_BUFFER];
+    int index;
+
+    while ((index = __sync_fetch_and_add(&validator->nextDir, 1)) < validator->numDirs)
+    {
+        char* dirName = validator->dirs[index];
+        int numProblems = 0;
+
+        // A world that cannot be loaded is reported as a single problem.
+        uint64_t start = StartTiming();
+        if (OpenWorld(&world, dirName, error) == false)
+        {
+            AppendFormat(&report, "%s\n", error);
+            numProblems = 1;
+        }
+        else
+        {
+            numProblems = ValidateWorld(&world, validator->options, dirName, &report);
+            FreeWorld(&world);
+        }
+        StopTiming(VALIDATE_WORLD, start);
+
+        // Print the report of an invalid world in one piece.
+        if (numProblems > 0)
+        {
+            if (numProblems > MAX_REPORTS)
+            {
+                AppendFormat(&report, "%s: and %d more problems\n", dirName, numProblems - MAX_REPORTS);
+            }
+            pthread_mutex_lock(&validator->outputMutex);
+            validator->numInvalid++;
+            FlushBuffer(&report);
+            pthread_mutex_unlock(&validator->outputMutex);
+        }
+    }
+
+    free(report.data);
+    return NULL;
+}
+
+/* Checks that a loaded world keeps the promises of buildrooms: connection counts within the bounds, matching
+   connections coming back, no connections to the room itself or repeated connections, exactly one START_ROOM and
+   one END_ROOM, and an END_ROOM that can be reached from the START_ROOM. Adds the first MAX_REPORTS problems to
+   the report and returns the number of problems found. */
+int ValidateWorld(struct World* world, struct Options* options, char* dirName, struct Buffer* report)
+{
+    int numProblems = 0;
+    int numStarts = 0;
+    int numEnds = 0;
+    uint32_t room, i, j;
+
+    // Marks each connection of the room being checked with the room index + 1, to find repeated connections.
+    uint32_t* marks = SafeRealloc(NULL, sizeof(uint32_t) * world->image.numRooms);
+    memset(marks, 0, sizeof(uint32_t) * world->image.numRooms);
+
+    for (room = 0; room < (uint32_t) world->image.numRooms; room++)
+    {
+        const char* name = GetRoomName(&world->image, room);
+        uint32_t numConnections = world->image.linkOffsets[room+1] - world->image.linkOffsets[room];
+
+        if (world->image.types[room] == START_ROOM)
+            numStarts++;
+        else if (world->image.types[room] == END_ROOM)
+            numEnds++;
+
+        if (numConnections < (uint32_t) options->minConnections || numConnections > (uint32_t) options->maxConnections)
+        {
+            ReportProblem(report, dirName, &numProblems, "room %s has %u connections, expected %d to %d", name,
+                          numConnections, options->minConnections, options->maxConnections);
+        }
+
+        for (i = world->image.linkOffsets[room]; i < world->image.linkOffsets[room+1]; i++)
+        {
+            uint32_t other = world->image.links[i];
+            if (other == room)
+            {
+                ReportProblem(report, dirName, &numProblems, "room %s connects to itself", name);
+                continue;
+            }
+            if (marks[other] == room + 1)
+            {
+                ReportProblem(report, dirName, &numProblems, "room %s connects to %s more than once", name,
+                              GetRoomName(&world->image, other));
+                continue;
+            }
+            marks[other] = room + 1;
+
+            // Look for the matching connection coming back.
+            for (j = world->image.linkOffsets[other];
+                 j < world->image.linkOffsets[other+1] && world->image.links[j] != room; j++)
+            {
+            }
+            if (j == world->image.linkOffsets[other+1])
+            {
+                ReportProblem(report, dirName, &numProblems, "room %s connects to %s, which does not connect back",
+                              name, GetRoomName(&world->image, other));
+            }
+        }
+    }
+    free(marks);
+
+    if (numStarts != 1)
+    {
+        ReportProblem(report, dirName, &numProblems, "there are %d START_ROOMs, expected 1", numStarts);
+    }
+    if (numEnds != 1)
+    {
+        ReportProblem(report, dirName, &numProblems, "there are %d END_ROOMs, expected 1", numEnds);
+    }
+
+    // Search from the "ending room" with the distance oracle's bitset frontiers.
+    BuildDistanceOracle(world);
+    if (world->distances[world->image.startRoom] == UNREACHABLE)
+    {
+        ReportProblem(report, dirName, &numProblems, "the END_ROOM cannot be reached from the START_ROOM");
+    }
+
+    return numProblems;
+}
+
+// Counts a problem found by the validator, and adds it to the report unless MAX_REPORTS have been added already.
+void ReportProblem(struct Buffer* report, char* dirName, int* numProblems, const char* format, ...)
+{
+    char problem[ERROR_BUFFER];
+    va_list args;
+
+    if ((*numProblems)++ >= MAX_REPORTS)
+    {
+        return;
+    }
+
+    va_start(args, format);
+    vsnprintf(problem, sizeof(problem), format, args);
+    va_end(args);
+    AppendFormat(report, "%s: %s\n", dirName, problem);
+}
+
+/* Times finding the newest world, loading each given world (from its room files and from its world file), building
+   its distance oracle and checking moves in it, printing the time and allocations per operation of each, and
+   compares them with a baseline (the output of an earlier run) if one is given. With no paths, the newest world is
+   used. Returns 0, or 1 if any benchmark regressed against the baseline. */
+int RunBenchmarks(struct Options* options, char* paths[], int numPaths)
+{
+    char dirName[PATH_MAX];
+    char filename[PATH_MAX];
+    char error[ERROR_BUFFER];
+    struct World world;
+    int i, j, numBaselines = 0;
+    bool regressed = false;
+
+    struct Baseline* baselines = options->baselineFilename != NULL
+                                 ? LoadBaselines(options->baselineFilename, &numBaselines) : NULL;
+    PrintBenchmarkHeader(baselines != NULL);
+    countAllocations = true;
+
+    // Finding the newest world, which does not depend on its size.
+    struct Benchmark benchmark = {.name = "find_world", .numRooms = 0};
+    while (IsBenchmarkDone(&benchmark) == false)
+    {
+        memset(dirName, '\0', PATH_MAX);
+        StartBenchmarkOp(&benchmark);
+        GetMostRecentDir(dirName);
+        StopBenchmarkOp(&benchmark);
+    }
+    regressed |= ReportBenchmark(&benchmark, baselines, numBaselines);
+
+    char* newestDir = dirName;
+    if (numPaths == 0)
+    {
+        paths = &newestDir;
+        numPaths = 1;
+    }
+
+    for (i = 0; i < numPaths; i++)
+    {
+        // Load the world once to learn its size, and to use for the oracle and move benchmarks.
+        if (OpenWorld(&world, paths[i], error) == false)
+        {
+            printf("ERROR: %s\n", error);
+            exit(1);
+        }
+        int numRooms = world.image.numRooms;
+
+        // Loading from the room files, if the world has them.
+        struct World loaded;
+        memset(&loaded, 0, sizeof(loaded));
+        if (InitRooms(&loaded, paths[i], error) == true)
+        {
+            FreeWorld(&loaded);
+            benchmark = (struct Benchmark) {.name = "load_text", .numRooms = numRooms};
+            while (IsBenchmarkDone(&benchmark) == false)
+            {
+                memset(&loaded, 0, sizeof(loaded));
+                StartBenchmarkOp(&benchmark);
+                InitRooms(&loaded, paths[i], error);
+                StopBenchmarkOp(&benchmark);
+                FreeWorld(&loaded);
+            }
+            regressed |= ReportBenchmark(&benchmark, baselines, numBaselines);
+        }
+
+        // Loading from the world file, if the world has one.
+        snprintf(filename, sizeof(filename), "%s/%s", paths[i], WORLD_FILENAME);
+        if (access(filename, F_OK) == 0)
+        {
+            benchmark = (struct Benchmark) {.name = "load_binary", .numRooms = numRooms};
+            while (IsBenchmarkDone(&benchmark) == false)
+            {
+                memset(&loaded, 0, sizeof(loaded));
+                StartBenchmarkOp(&benchmark);
+                MapWorldFile(&loaded, filename, error);
+                StopBenchmarkOp(&benchmark);
+                FreeWorld(&loaded);
+            }
+            regressed |= ReportBenchmark(&benchmark, baselines, numBaselines);
+        }
+
+        // Building the distance oracle.
+        benchmark = (struct Benchmark) {.name = "build_oracle", .numRooms = numRooms};
+        while (IsBenchmarkDone(&benchmark) == false)
+        {
+            StartBenchmarkOp(&benchmark);
+            BuildDistanceOracle(&world);
+            StopBenchmarkOp(&benchmark);
+            free(world.distances);
+            free(world.nextHops);
+        }
+        world.distances = NULL;
+        world.nextHops = NULL;
+        regressed |= ReportBenchmark(&benchmark, baselines, numBaselines);
+
+        // Checking moves: half to a connection of the room, half to a random room (which is rarely a connection).
+        int* fromRooms = SafeRealloc(NULL, sizeof(int) * MOVE_QUERIES);
+        const char** toNames = SafeRealloc(NULL, sizeof(char*) * MOVE_QUERIES);
+        uint32_t random = 2463534242U;
+        for (j = 0; j < MOVE_QUERIES; j++)
+        {
+            random ^= random << 13;
+            random ^= random >> 17;
+            random ^= random << 5;
+            int room = random % numRooms;
+            uint32_t numConnections = world.image.linkOffsets[room+1] - world.image.linkOffsets[room];
+            fromRooms[j] = room;
+            toNames[j] = GetRoomName(&world.image, j % 2 == 0 && numConnections > 0
+                                     ? world.image.links[world.image.linkOffsets[room] + random % numConnections]
+                                     : (random >> 8) % numRooms);
+        }
+
+        benchmark = (struct Benchmark) {.name = "move", .numRooms = numRooms};
+        volatile int sink = 0;
+        while (IsBenchmarkDone(&benchmark) == false)
+        {
+            StartBenchmarkOp(&benchmark);
+            for (j = 0; j < MOVE_QUERIES; j++)
+            {
+                sink += GetSelectedRoomIndex(&world, fromRooms[j], (char*) toNames[j]);
+            }
+            StopBenchmarkOp(&benchmark);
+        }
+        benchmark.numOps *= MOVE_QUERIES;   // Each timed operation above checked MOVE_QUERIES moves.
+        regressed |= ReportBenchmark(&benchmark, baselines, numBaselines);
+
+        free(fromRooms);
+        free(toNames);
+        FreeWorld(&world);
+    }
+
+    free(baselines);
+    return regressed == true ? 1 : 0;
+}
+
+// Set by HandleStopSignal() to stop the server.
+volatile sig_atomic_t stopRequested = 0;
+int stopPipe = -1;
+
+/* Serves games on a Unix domain socket until SIGINT or SIGTERM is received. The main thread runs a poll() loop over
+   the listening socket and the idle clients. When a client has input, it is handed to a worker thread as a task,
+   and poll() stops watching it until the worker hands it back. Returns 0 once stopped. */
+int RunServer(struct World* world, struct TimeService* timeService, struct Options* options)
+{
+    struct Server server;
+    int i;
+
+    server.world = world;
+    server.timeService = timeService;
+    server.options = options;
+    server.numWorkers = options->numWorkers;
+    server.numTasks = 0;
+    server.stopping = false;
+    server.doneClients = NULL;
+    pthread_mutex_init(&server.idleMutex, NULL);
+    pthread_cond_init(&server.workAvailable, NULL);
+    pthread_mutex_init(&server.doneMutex, NULL);
+    if (pipe(server.wakePipe) != 0)
+    {
+        printf("ERROR: Failed to create the wake up pipe\n");
+        perror("In RunServer() with pipe()");
+        exit(1);
+    }
+    fcntl(server.wakePipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(server.wakePipe[1], F_SETFL, O_NONBLOCK);
+
+    // Create the listening socket.
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(options->socketPath) >= sizeof(address.sun_path))
+    {
+        printf("ERROR: Socket path \"%s\" is too long\n", options->socketPath);
+        exit(1);
+    }
+    strcpy(address.sun_path, options->socketPath);
+    unlink(options->socketPath);
+
+    int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd == -1 || bind(listenFd, (struct sockaddr*) &address, sizeof(address)) != 0
+        || listen(listenFd, SOMAXCONN) != 0 || fcntl(listenFd, F_SETFL, O_NONBLOCK) != 0)
+    {
+        printf("ERROR: Failed to listen on socket \"%s\"\n", options->socketPath);
+        perror("In RunServer()");
+        exit(1);
+    }
+
+    /* Stop cleanly on SIGINT and SIGTERM, and report broken connections through send() instead of SIGPIPE. The stop
+       handler is installed without SA_RESTART, so that a signal always makes poll() return. */
+    stopPipe = server.wakePipe[1];
+    struct sigaction stopAction;
+    memset(&stopAction, 0, sizeof(stopAction));
+    stopAction.sa_handler = HandleStopSignal;
+    sigemptyset(&stopAction.sa_mask);
+    sigaction(SIGINT, &stopAction, NULL);
+    sigaction(SIGTERM, &stopAction, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    // Start the workers.
+    server.queues = SafeRealloc(NULL, sizeof(struct WorkQueue) * server.numWorkers);
+    server.workers = SafeRealloc(NULL, sizeof(struct Worker) * server.numWorkers);
+    for (i = 0; i < server.numWorkers; i++)
+    {
+        pthread_mutex_init(&server.queues[i].mutex, NULL);
+        server.queues[i].capacity = 16;
+        server.queues[i].tasks = SafeRealloc(NULL, sizeof(struct Client*) * server.queues[i].capacity);
+        server.queues[i].head = 0;
+        server.queues[i].count = 0;
+    }
+    for (i = 0; i < server.numWorkers; i++)
+    {
+        server.workers[i].server = &server;
+        server.workers[i].index = i;
+        if ((pthread_create(&server.workers[i].thread, NULL, RunWorker, (void*) &server.workers[i])) != 0)
+        {
+            printf("ERROR: There was a problem creating a worker thread\n");
+            perror("In RunServer() with pthread_create()");
+            exit(1);
+        }
+    }
+    printf("Serving games on %s with %d workers\n", options->socketPath, server.numWorkers);
+    fflush(stdout);
+
+    /* The poll() set holds the wake up pipe, the listening socket, then one entry per idle client. Every connection
+       is non-blocking, and a client's output that the connection does not take at once is queued and sent when poll()
+       finds it writable. While that queue is full, the client's input is not read, so a player who never reads the
+       output cannot make the server block or grow without limit. */
+    struct Client* clients = NULL;
+    struct pollfd* pollFds = NULL;
+    struct Client** pollClients = NULL;
+    size_t pollCapacity = 0;
+    int nextWorker = 0;
+
+    while (stopRequested == 0)
+    {
+        // Rebuild the poll() set from the idle clients.
+        size_t numFds = 2;
+        struct Client* client;
+        for (client = clients; client != NULL; client = client->next)
+        {
+            if (numFds + 1 > pollCapacity)
+            {
+                pollCapacity = (numFds + 1) * 2;
+                pollFds = SafeRealloc(pollFds, sizeof(struct pollfd) * pollCapacity);
+                pollClients = SafeRealloc(pollClients, sizeof(struct Client*) * pollCapacity);
+            }
+            pollFds[numFds].fd = client->fd;
+            pollFds[numFds].events = 0;
+            if (client->finished == false && client->out.length < MAX_CLIENT_OUTPUT)
+            {
+                pollFds[numFds].events |= POLLIN;
+            }
+            if (client->out.length > 0)
+            {
+                pollFds[numFds].events |= POLLOUT;
+            }
+            pollClients[numFds] = client;
+            numFds++;
+        }
+        if (pollCapacity < 2)
+        {
+            pollCapacity = 16;
+            pollFds = SafeRealloc(pollFds, sizeof(struct pollfd) * pollCapacity);
+            pollClients = SafeRealloc(pollClients, sizeof(struct Client*) * pollCapacity);
+        }
+        pollFds[0].fd = server.wakePipe[0];
+        pollFds[0].events = POLLIN;
+        pollFds[1].fd = listenFd;
+        pollFds[1].events = POLLIN;
+
+        if (poll(pollFds, numFds, -1) == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            printf("ERROR: Failed to wait for the clients\n");
+            perror("In RunServer() with poll()");
+            exit(1);
+        }
+
+        // Take back the clients finished by the workers, closing the ones whose game is over.
+        if (pollFds[0].revents & POLLIN)
+        {
+            char drain[64];
+            while (read(server.wakePipe[0], drain, sizeof(drain)) > 0)
+                ;
+            pthread_mutex_lock(&server.doneMutex);
+            struct Client* done = server.doneClients;
+            server.doneClients = NULL;
+            pthread_mutex_unlock(&server.doneMutex);
+
+            while (done != NULL)
+            {
+                struct Client* nextDone = done->next;
+                done->next = clients;
+                clients = done;
+                done = nextDone;
+            }
+        }
+
+        // Accept a new player and greet them with the starting room.
+        if (pollFds[1].revents & POLLIN)
+        {
+            int fd = accept4(listenFd, NULL, NULL, SOCK_NONBLOCK);
+            if (fd != -1)
+            {
+                CountStat(CLIENTS_COUNTER);
+                struct Client* newClient = SafeRealloc(NULL, sizeof(struct Client));
+                newClient->fd = fd;
+                newClient->commandLength = 0;
+                newClient->inputStart = 0;
+                newClient->inputLength = 0;
+                newClient->out = (struct Buffer) {NULL, 0, 0};
+                newClient->finished = false;
+                newClient->ready = false;
+                newClient->moreInput = false;
+                InitSession(&newClient->session, world, options->spillLimit);
+
+                WritePrompt(world, &newClient->session, &newClient->out);
+                FlushOutput(newClient);
+
+                newClient->next = clients;
+                clients = newClient;
+            }
+        }
+
+        // Send the queued output the connections now take, and find the clients with input (or a closed connection).
+        size_t k;
+        for (k = 2; k < numFds; k++)
+        {
+            client = pollClients[k];
+            if ((pollFds[k].revents & (POLLOUT | POLLERR | POLLHUP)) && client->out.length > 0)
+            {
+                FlushOutput(client);
+            }
+            if ((pollFds[k].revents & (POLLIN | POLLERR | POLLHUP)) && client->finished == false)
+            {
+                client->ready = true;
+            }
+        }
+
+        /* Close finished clients once their output is sent, and hand every client with input (and room for its
+           output) to a worker, round robin, unlinking it from the list so that poll() stops watching it until the
+           worker hands it back. */
+        struct Client** link = &clients;
+        while (*link != NULL)
+        {
+            client = *link;
+            if (client->finished == true && client->out.length == 0)
+            {
+                *link = client->next;
+                close(client->fd);
+                FreeSession(&client->session);
+                free(client->out.data);
+                free(client);
+            }
+            else if (client->finished == false && (client->ready == true || client->moreInput == true)
+                     && client->out.length < MAX_CLIENT_OUTPUT)
+            {
+                *link = client->next;
+                client->ready = false;
+                QueueTask(&server, client, nextWorker);
+                nextWorker = (nextWorker + 1) % server.numWorkers;
+            }
+            else
+            {
+                link = &client->next;
+            }
+        }
+    }
+
+    // Stop the workers.
+    pthread_mutex_lock(&server.idleMutex);
+    server.stopping = true;
+    pthread_cond_broadcast(&server.workAvailable);
+    pthread_mutex_unlock(&server.idleMutex);
+    for (i = 0; i < server.numWorkers; i++)
+    {
+        pthread_join(server.workers[i].thread, NULL);
+    }
+
+    // Close every connection, including any still queued or handed back.
+    for (i = 0; i < server.numWorkers; i++)
+    {
+        while (server.queues[i].count > 0)
+        {
+            struct Client* queued = server.queues[i].tasks[server.queues[i].head];
+            server.queues[i].head = (server.queues[i].head + 1) % server.queues[i].capacity;
+            server.queues[i].count--;
+            queued->next = clients;
+            clients = queued;
+        }
+        free(server.queues[i].tasks);
+        pthread_mutex_destroy(&server.queues[i].mutex);
+    }
+    while (server.doneClients != NULL)
+    {
+        struct Client* done = server.doneClients;
+        server.doneClients = done->next;
+        done->next = clients;
+        clients = done;
+    }
+    while (clients != NULL)
+    {
+        struct Client* client = clients;
+        clients = client->next;
+        close(client->fd);
+        FreeSession(&client->session);
+        free(client->out.data);
+        free(client);
+    }
+
+    close(listenFd);
+    unlink(options->socketPath);
+    close(server.wakePipe[0]);
+    close(server.wakePipe[1]);
+    free(server.queues);
+    free(server.workers);
+    free(pollFds);
+    free(pollClients);
+    pthread_mutex_destroy(&server.idleMutex);
+    pthread_cond_destroy(&server.workAvailable);
+    pthread_mutex_destroy(&server.doneMutex);
+
+    return 0;
+}
+
+// Requests the server to stop, waking up its poll() loop.
+void HandleStopSignal(int signalNumber)
+{
+    int savedErrno = errno;
+    (void) signalNumber;
+    stopRequested = 1;
+    if (stopPipe != -1)
+    {
+        write(stopPipe, "x", 1);
+    }
+    errno = savedErrno;
+}
+
+// Adds a client with input to process to the end of a worker's queue, and wakes up a sleeping worker.
+void QueueTask(struct Server* server, struct Client* client, int worker)
+{
+    struct WorkQueue* queue = &server->queues[worker];
+
+    pthread_mutex_lock(&queue->mutex);
+    if (queue->count == queue->capacity)
+    {
+        // Grow the ring buffer, unwrapping the tasks into the new space.
+        struct Client** tasks = SafeRealloc(NULL, sizeof(struct Client*) * queue->capacity * 2);
+        size_t i;
+        for (i = 0; i < queue->count; i++)
+        {
+            tasks[i] = queue->tasks[(queue->head + i) % queue->capacity];
+        }
+        free(queue->tasks);
+        queue->tasks = tasks;
+        queue->head = 0;
+        queue->capacity *= 2;
+    }
+    queue->tasks[(queue->head + queue->count) % queue->capacity] = client;
+    queue->count++;
+    pthread_mutex_unlock(&queue->mutex);
+
+    pthread_mutex_lock(&server->idleMutex);
+    server->numTasks++;
+    pthread_cond_signal(&server->workAvailable);
+    pthread_mutex_unlock(&server->idleMutex);
+}
+
+/* Takes a task for a worker: the newest task of its own queue, or else the oldest task of another worker's queue.
+   Returns NULL if every queue is empty. */
+struct Client* TakeTask(struct Server* server, int worker)
+{
+    struct Client* client = NULL;
+    int i;
+
+    for (i = 0; i < server->numWorkers && client == NULL; i++)
+    {
+        struct WorkQueue* queue = &server->queues[(worker + i) % server->numWorkers];
+        pthread_mutex_lock(&queue->mutex);
+        if (queue->count > 0)
+        {
+            if (i == 0)
+            {
+                client = queue->tasks[(queue->head + queue->count - 1) % queue->capacity];
+            }
+            else
+            {
+                client = queue->tasks[queue->head];
+                queue->head = (queue->head + 1) % queue->capacity;
+            }
+            queue->count--;
+        }
+        pthread_mutex_unlock(&queue->mutex);
+    }
+
+    if (client != NULL)
+    {
+        pthread_mutex_lock(&server->idleMutex);
+        server->numTasks--;
+        pthread_mutex_unlock(&server->idleMutex);
+    }
+    return client;
+}
+
+// Runs in each worker thread, processing client input until the server stops.
+void* RunWorker(void* arg)
+{
+    struct Server* server = ((struct Worker*) arg)->server;
+    int worker = ((struct Worker*) arg)->index;
+
+    while (1)
+    {
+        // Sleep until there is a task somewhere.
+        pthread_mutex_lock(&server->idleMutex);
+        while (server->numTasks == 0 && server->stopping == false)
+        {
+            pthread_cond_wait(&server->workAvailable, &server->idleMutex);
+        }
+        bool stopping = server->stopping;
+        pthread_mutex_unlock(&server->idleMutex);
+        if (stopping == true)
+        {
+            break;
+        }
+
+        struct Client* client = TakeTask(server, worker);
+        if (client == NULL)
+        {
+            continue;
+        }
+        ProcessClientInput(server, client);
+
+        // Hand the client back to the poll() loop.
+        pthread_mutex_lock(&server->doneMutex);
+        client->next = server->doneClients;
+        server->doneClients = client;
+        pthread_mutex_unlock(&server->doneMutex);
+        write(server->wakePipe[1], "x", 1);
+    }
+
+    return NULL;
+}
+
+/* Reads the input waiting on a client's connection, and processes and answers the complete commands in it. Stops
+   after TASK_COMMANDS commands, or once the client's queued output reaches MAX_CLIENT_OUTPUT, leaving the rest of
+   the input for a later task so that one player cannot hold a worker or fill the server's memory. */
+void ProcessClientInput(struct Server* server, struct Client* client)
+{
+    char strTime[STR_BUFFER];
+    int numCommands = 0;
+
+    client->moreInput = false;
+    while (client->finished == false)
+    {
+        if (numCommands == TASK_COMMANDS || client->out.length >= MAX_CLIENT_OUTPUT)
+        {
+            client->moreInput = true;
+            break;
+        }
+        if (client->inputStart == client->inputLength)
+        {
+            ssize_t numRead = recv(client->fd, client->input, sizeof(client->input), 0);
+            if (numRead <= 0)
+            {
+                // Stop once the waiting input is used up, or when the player disconnected.
+                if (numRead == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+                {
+                    client->finished = true;
+                }
+                break;
+            }
+            client->inputStart = 0;
+            client->inputLength = numRead;
+        }
+
+        // Collect characters until the end of the line (a command that is too long is cut short).
+        char c = client->input[client->inputStart++];
+        if (c != '\n')
+        {
+            if (c != '\r' && client->commandLength < COMMAND_BUFFER - 1)
+            {
+                client->command[client->commandLength++] = c;
+            }
+            continue;
+        }
+        client->command[client->commandLength] = '\0';
+        client->commandLength = 0;
+        numCommands++;
+
+        enum Results result = ProcessCommand(server->world, server->timeService, &client->session,
+                                             client->command, strTime);
+        WriteResponse(server->world, &client->session, result, strTime, &client->out);
+        if (GetRoomType(server->world, client->session.currentRoom) == END_ROOM)
+        {
+            client->finished = true;
+        }
+    }
+
+    FlushOutput(client);
+}
+
+/* Sends as much of a client's queued output as its connection takes without blocking, keeping the rest queued. The
+   output of a player who disconnected is dropped, and their game is over. */
+void FlushOutput(struct Client* client)
+{
+    uint64_t start = StartTiming();
+    size_t sent = 0;
+    while (sent < client->out.length)
+    {
+        ssize_t numSent = send(client->fd, client->out.data + sent, client->out.length - sent, MSG_NOSIGNAL);
+        if (numSent == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (numSent <= 0)
+        {
+            if (numSent == -1 && errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                client->finished = true;
+                sent = client->out.length;
+            }
+            break;
+        }
+        sent += numSent;
+    }
+
+    // Move the unsent output to the front of the queue.
+    if (sent > 0)
+    {
+        memmove(client->out.data, client->out.data + sent, client->out.length - sent);
+        client->out.length -= sent;
+    }
+    StopTiming(WRITE_OUTPUT, start);
+}
+
+/* Reads a whole file into a newly allocated buffer with one spare byte at the end (so that the last line can be
+   null-terminated in place), and sets size to the number of bytes read. */
+char* ReadWholeFile(char* filename, size_t* size)
+{
+    FILE* file;
+    if ((file = fopen(filename, "rb")) == NULL)
+    {
+        printf("ERROR: Failed to open filename \"%s\"\n", filename);
+        perror("In ReadWholeFile()");
+        exit(1);
+    }
+
+    size_t capacity = 4096;
+    char* buffer = SafeRealloc(NULL, capacity);
+    size_t numRead;
+    *size = 0;
+    while ((numRead = fread(buffer + *size, 1, capacity - *size - 1, file)) > 0)
+    {
+        *size += numRead;
+        if (*size + 1 == capacity)
+        {
+            capacity *= 2;
+            buffer = SafeRealloc(buffer, capacity);
+        }
+    }
+    buffer[*size] = '\0';
+    fclose(file);
+
+    return buffer;
+}
+
+// Returns the number of seconds elapsed since start, on the monotonic clock.
+double ElapsedSeconds(struct timespec* start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// Reads the command line options.
+void ParseArgs(int argc, char* argv[], struct Options* options)
+{
+    int opt;
+
+    options->spillLimit = 0;
+    options->writeTimeFile = false;
+    options->recordFilename = NULL;
+    options->runScripts = false;
+    options->socketPath = NULL;
+    options->numWorkers = 0;
+    options->validate = false;
+    options->benchmark = false;
+    options->baselineFilename = NULL;
+    options->minConnections = MIN_CONNECTIONS;
+    options->maxConnections = MAX_CONNECTIONS;
+    options->cacheSize = 0;
+    options->usePool = false;
+    options->shareWorld = false;
+    options->checkpointFilename = NULL;
+
+    // Timing can also be turned on from the environment, so that it works without changing how the game is run.
+    char* timingFile = getenv("ADVENTURE_TIMING");
+    char* statsDir = getenv("ADVENTURE_STATS");
+
+    while ((opt = getopt(argc, argv, "s:tR:rS:j:Vm:M:T:Bb:L:PHC:E:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'S': options->socketPath = optarg; break;
+            case 'j': options->numWorkers = atoi(optarg); break;
+            case 's': options->spillLimit = strtoul(optarg, NULL, 10); break;
+            case 't': options->writeTimeFile = true; break;
+            case 'R': options->recordFilename = optarg; break;
+            case 'r': options->runScripts = true; break;
+            case 'V': options->validate = true; break;
+            case 'm': options->minConnections = atoi(optarg); break;
+            case 'M': options->maxConnections = atoi(optarg); break;
+            case 'T': timingFile = optarg; break;
+            case 'E': statsDir = optarg; break;
+            case 'B': options->benchmark = true; break;
+            case 'b': options->benchmark = true; options->baselineFilename = optarg; break;
+            case 'L': options->cacheSize = strtoul(optarg, NULL, 10) * 1024; break;
+            case 'P': options->usePool = true; break;
+            case 'H': options->shareWorld = true; break;
+            case 'C': options->checkpointFilename = optarg; break;
+            default: PrintUsage(argv[0]); exit(1);
+        }
+    }
+
+    if (options->runScripts == true && optind == argc)
+    {
+        printf("ERROR: -r needs at least one script\n");
+        PrintUsage(argv[0]);
+        exit(1);
+    }
+    if (options->cacheSize > 0 && (options->socketPath != NULL || options->validate == true
+                                   || options->benchmark == true))
+    {
+        printf("ERROR: -L can only be used to play an interactive game or run scripts\n");
+        exit(1);
+    }
+    if (options->usePool == true && (options->validate == true || options->benchmark == true))
+    {
+        printf("ERROR: -P can only be used to play a game, run scripts or serve games\n");
+        exit(1);
+    }
+    if (options->shareWorld == true && (options->cacheSize > 0 || options->usePool == true
+                                        || options->validate == true || options->benchmark == true))
+    {
+        printf("ERROR: -H can only be used to play the newest world, run scripts or serve games, without -L or -P\n");
+        exit(1);
+    }
+    if (options->checkpointFilename != NULL && (options->runScripts == true || options->socketPath != NULL
+                                                || options->cacheSize > 0 || options->validate == true
+                                                || options->benchmark == true))
+    {
+        printf("ERROR: -C can only be used to play an interactive game, without -L\n");
+        exit(1);
+    }
+    if (timingFile != NULL && timingFile[0] != '\0')
+    {
+        EnableTiming(timingFile);
+    }
+    if (statsDir != NULL && statsDir[0] != '\0' && options->validate == false && options->benchmark == false)
+    {
+        EnableStats(statsDir);
+    }
+
+    // The server defaults to a fixed pool of workers, the validator to one thread per core.
+    if (options->numWorkers == 0)
+    {
+        options->numWorkers = options->validate == true ? sysconf(_SC_NPROCESSORS_ONLN) : NUM_OF_WORKERS;
+    }
+    if (options->numWorkers < 1)
+    {
+        printf("ERROR: The number of workers must be at least 1\n");
+        exit(1);
+    }
+    if (options->minConnections < 0 || options->minConnections > options->maxConnections)
+    {
+        printf("ERROR: Connection bounds must satisfy 0 <= min <= max\n");
+        exit(1);
+    }
+}
+
+// Prints the command line options.
+void PrintUsage(char* program)
+{
+    printf("Usage: %s [-P | -H] [-s spill-limit] [-t] [-R record-file | -r script... | -S socket-path [-j workers]]\n",
+           program);
+    printf("       %s [-P] -L cache-kb [-s spill-limit] [-t] [-R record-file | -r script...]\n", program);
+    printf("       %s [-P | -H] [-s spill-limit] [-t] [-R record-file] -C checkpoint-file\n", program);
+    printf("       %s -V [-j threads] [-m min-connections] [-M max-connections] [path...]\n", program);
+    printf("       %s -B [-b baseline] [path...]\n", program);
+    printf("  -P              Claim a world of its own from the %s directory kept full by buildrooms -P, and\n"
+           "                  remove it when done, instead of playing the newest world.\n", POOL_DIRNAME);
+    printf("  -H              Play the newest world from a shared memory copy that every game started with -H\n"
+           "                  attaches to, loading it into the copy first if no game has yet.\n");
+    printf("  -s spill-limit  Keep at most this many rooms of the path in memory, spilling older ones to disk.\n");
+    printf("  -t              Also write the time to \"currentTime.txt\" whenever the time command is used.\n");
+    printf("  -R record-file  Record every command typed to a file that can be replayed with -r.\n");
+    printf("  -C checkpoint-file\n"
+           "                  Save the game to this file after every move, and resume it from there when started\n"
+           "                  again. The file is removed once the game is won.\n");
+    printf("  -r script...    Play each script (one command per line) without prompts and report the results.\n");
+    printf("  -S socket-path  Serve games to many players on a Unix domain socket.\n");
+    printf("  -L cache-kb     Load rooms from their room files as they are needed, caching at most this many\n"
+           "                  kilobytes of rooms. Hints and the shortest path are not available, unless the\n"
+           "                  world has a binary world file.\n");
+    printf("  -j workers      Number of worker threads running the players' commands (default %d), or checking\n"
+           "                  worlds with -V (default one per core).\n", NUM_OF_WORKERS);
+    printf("  -V path...      Check the rooms.* worlds in each path (default the current directory) and report every\n"
+           "                  problem found.\n");
+    printf("  -m, -M          Connection bounds every room is checked against with -V (default %d to %d).\n",
+           MIN_CONNECTIONS, MAX_CONNECTIONS);
+    printf("  -T timing-file  Time the phases and commands, and dump the timings on exit to stderr and, as JSON, to\n"
+           "                  timing-file (\"-\" for stderr). Also turned on by setting ADVENTURE_TIMING.\n");
+    printf("  -E stats-dir    Keep live counters in stats-dir/%sPID%s for advstats to read while the game runs.\n"
+           "                  Also turned on by setting ADVENTURE_STATS.\n", STATS_PREFIX, STATS_SUFFIX);
+    printf("  -B path...      Benchmark finding, loading and playing each world (default the newest world).\n");
+    printf("  -b baseline     Benchmark, and compare with the results of an earlier -B run saved to a file.\n");
+}
+
+// Initializes an empty path.
+void InitPath(struct Path* path, size_t spillLimit)
+{
+    path->numRooms = 0;
+    path->capacity = PATH_CAPACITY;
+    path->rooms = SafeRealloc(NULL, sizeof(uint32_t) * path->capacity);
+    path->spillLimit = spillLimit;
+    path->spillFile = NULL;
+    path->numSpilled = 0;
+}
+
+// Frees the memory held by a path, which also deletes its spill file.
+void FreePath(struct Path* path)
+{
+    free(path->rooms);
+    path->rooms = NULL;
+    if (path->spillFile != NULL)
+    {
+        fclose(path->spillFile);
+        path->spillFile = NULL;
+    }
+}
+
+// Takes the index of a valid room choice made by the user and appends it to the path.
+void RecordValidChoice(struct Path* path, int roomIndex)
+{
+    // Once the spill limit is reached, move the rooms held in memory to the end of the spill file.
+    if (path->spillLimit > 0 && path->numRooms >= path->spillLimit)
+    {
+        if (path->spillFile == NULL && (path->spillFile = tmpfile()) == NULL)
+        {
+            printf("ERROR: Failed to create the path spill file\n");
+            perror("In RecordValidChoice()");
+            exit(1);
+        }
+        if (fwrite(path->rooms, sizeof(uint32_t), path->numRooms, path->spillFile) != path->numRooms)
+        {
+            printf("ERROR: Failed to write the path spill file\n");
+            perror("In RecordValidChoice()");
+            exit(1);
+        }
+        path->numSpilled += path->numRooms;
+        path->numRooms = 0;
+    }
+
+    // Otherwise grow the array geometrically when it is full.
+    if (path->numRooms == path->capacity)
+    {
+        path->capacity *= 2;
+        path->rooms = SafeRealloc(path->rooms, sizeof(uint32_t) * path->capacity);
+    }
+
+    path->rooms[path->numRooms++] = roomIndex;
+}
+
+// Appends the names of the given rooms, one per line, to an output buffer.
+void AppendRoomNames(struct World* world, const uint32_t* rooms, size_t numRooms, struct Buffer* out)
+{
+    size_t i;
+    for (i = 0; i < numRooms; i++)
+    {
+        AppendText(out, GetRoomName(&world->image, rooms[i]), GetNameLength(&world->image, rooms[i]));
+        AppendText(out, "\n", 1);
+    }
+}
+
+// Adds the recorded player path to the output, which is built in full before it is written at once.
+void PrintPlayerPath(struct World* world, struct Path* path, struct Buffer* out)
+{
+    uint64_t start = StartTiming();
+
+    // Read back any spilled rooms first, in blocks.
+    if (path->spillFile != NULL)
+    {
+        uint32_t block[1024];
+        size_t numRead;
+        rewind(path->spillFile);
+        while ((numRead = fread(block, sizeof(uint32_t), 1024, path->spillFile)) > 0)
+        {
+            AppendRoomNames(world, block, numRead, out);
+        }
+
+        // Go back to the end so that more rooms can be spilled.
+        fseek(path->spillFile, 0, SEEK_END);
+    }
+
+    // Then the rooms still in memory.
+    AppendRoomNames(world, path->rooms, path->numRooms, out);
+    StopTiming(PRINT_PATH, start);
+}
+
+// Initializes the time service and starts its second thread.
+void StartTimeService(struct TimeService* service, bool writeFile)
+{
+    pthread_mutex_init(&service->mutex, NULL);
+    pthread_cond_init(&service->requestReady, NULL);
+    pthread_cond_init(&service->responseReady, NULL);
+    service->requests = 0;
+    service->responses = 0;
+    service->stopping = false;
+    service->writeFile = writeFile;
+
+    // Fill the cache before the first request.
+    FormatTime(service, time(NULL));
+
+    if ((pthread_create(&service->thread, NULL, WriteTime, (void*) service)) != 0)
+    {
+        printf("ERROR: There was a problem creating a second thread\n");
+        perror("In StartTimeService() with pthread_create()");
+        exit(1);
+    }
+}
+
+// Stops the second thread and destroys the time service.
+void StopTimeService(struct TimeService* service)
+{
+    pthread_mutex_lock(&service->mutex);
+    service->stopping = true;
+    pthread_cond_signal(&service->requestReady);
+    pthread_mutex_unlock(&service->mutex);
+
+    pthread_join(service->thread, NULL);
+
+    pthread_cond_destroy(&service->requestReady);
+    pthread_cond_destroy(&service->responseReady);
+    pthread_mutex_destroy(&service->mutex);
+}
+
+/* Runs in the second thread for the whole game. Waits for time requests, refreshing the cached time at the start of
+   every minute in between, and answers each request (writing "currentTime.txt" as well if asked to). */
+void* WriteTime(void* arg)
+{
+    struct TimeService* service = arg;
+
+    pthread_mutex_lock(&service->mutex);
+    while (service->stopping == false)
+    {
+        // Sleep until the next request, or until the next minute starts.
+        if (service->responses == service->requests)
+        {
+            struct timespec wakeTime;
+            wakeTime.tv_sec = (service->cachedMinute + 1) * 60;
+            wakeTime.tv_nsec = 0;
+            pthread_cond_timedwait(&service->requestReady, &service->mutex, &wakeTime);
+        }
+
+        // Refresh the cache if the minute changed.
+        uint64_t start = StartTiming();
+        time_t now = time(NULL);
+        if (now / 60 != service->cachedMinute)
+        {
+            FormatTime(service, now);
+        }
+
+        // Answer the requests made so far.
+        if (service->responses != service->requests)
+        {
+            service->responses = service->requests;
+            pthread_cond_broadcast(&service->responseReady);
+
+            // Write the time to a file called "currentTime.txt", and truncate if the file already exists.
+            if (service->writeFile == true)
+            {
+                FILE* file;
+                if ((file = fopen("currentTime.txt", "w")) == NULL)
+                {
+                    printf("ERROR: Failed to open filename \"currentTime.txt\"\n");
+                    perror("In WriteTime()");
+                    exit(1);
+                }
+                fputs(service->cachedTime, file);
+                fclose(file);
+            }
+        }
+        StopTiming(TIME_UPDATE, start);
+    }
+    pthread_mutex_unlock(&service->mutex);
+
+    return NULL;
+}
+
+// Formats the given time into the cache. Called with the mutex held (or before the second thread starts).
+void FormatTime(struct TimeService* service, time_t now)
+{
+    struct tm local_tm;
+    localtime_r(&now, &local_tm);
+
+    // Get the formated string.
+    memset(service->cachedTime, '\0', STR_BUFFER);
+    strftime(service->cachedTime, STR_BUFFER, "%l:%M%P, %A, %B %d, %Y", &local_tm);
+    service->cachedMinute = now / 60;
+}
+
+/* Copies the current time into strTime. Uses the cache directly if it is still current, and otherwise (or if the
+   time also has to be written to "currentTime.txt") asks the second thread and waits for its answer. */
+void GetTime(struct TimeService* service, char strTime[])
+{
+    uint64_t start = StartTiming();
+    pthread_mutex_lock(&service->mutex);
+    if (service->writeFile == true || time(NULL) / 60 != service->cachedMinute)
+    {
+        unsigned long request = ++service->requests;
+        pthread_cond_signal(&service->requestReady);
+        while (service->responses < request)
+        {
+            pthread_cond_wait(&service->responseReady, &service->mutex);
+        }
+    }
+    memcpy(strTime, service->cachedTime, STR_BUFFER);
+    pthread_mutex_unlock(&service->mutex);
+    StopTiming(TIME_REQUEST, start);
+}
+
+// Displays the time provided by the second thread.
+void DisplayTime(char strTime[], struct Buffer* out)
+{
+    AppendFormat(out, "\n%s\n\n", strTime);
+}
+
+// Set by -T or the ADVENTURE_TIMING environment variable, see EnableTiming().
+bool timingEnabled = false;
+char* timingFilename = NULL;
+struct Histogram histograms[NUM_OF_METRICS];
+
+/* Turns on the timing of the phases and commands, and has the timings dumped when the program exits: as a table on
+   stderr, and as JSON to the given file ("-" for stderr). */
+void EnableTiming(char* filename)
+{
+    memset(histograms, 0, sizeof(histograms));
+    timingFilename = filename;
+    timingEnabled = true;
+    atexit(DumpTimings);
+}
+
+// Returns the monotonic clock in nanoseconds if timing is on, and 0 otherwise.
+uint64_t StartTiming(void)
+{
+    struct timespec now;
+    if (timingEnabled == false)
+    {
+        return 0;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/* Records the time since StartTiming() in the histogram of a metric. Any thread can record at the same time, so the
+   histogram is only updated with atomic operations. */
+void StopTiming(enum Metrics metric, uint64_t start)
+{
+    if (timingEnabled == false)
+    {
+        return;
+    }
+    uint64_t elapsed = StartTiming() - start;
+    struct Histogram* histogram = &histograms[metric];
+
+    __sync_fetch_and_add(&histogram->count, 1);
+    __sync_fetch_and_add(&histogram->total, elapsed);
+    __sync_fetch_and_add(&histogram->buckets[GetBucket(elapsed)], 1);
+
+    uint64_t max = histogram->max;
+    while (elapsed > max && __sync_bool_compare_and_swap(&histogram->max, max, elapsed) == false)
+    {
+        max = histogram->max;
+    }
+}
+
+/* Returns the histogram bucket of a time in nanoseconds. Times under 4 nanoseconds have a bucket each, and every
+   power of two above that is split into 4 buckets, so a bucket is never more than 25% wide. */
+int GetBucket(uint64_t nanoseconds)
+{
+    if (nanoseconds < 4)
+    {
+        return nanoseconds;
+    }
+    int exponent = 63 - __builtin_clzll(nanoseconds);
+    return (exponent - 1) * 4 + ((nanoseconds >> (exponent - 2)) & 3);
+}
+
+// Returns the time below which the given fraction of a metric's times fall, as the top of the bucket it is in.
+uint64_t GetPercentile(struct Histogram* histogram, double fraction)
+{
+    uint64_t rank = (uint64_t) (fraction * histogram->count + 0.5);
+    uint64_t seen = 0;
+    int i;
+
+    if (rank < 1)
+    {
+        rank = 1;
+    }
+    for (i = 0; i < NUM_OF_BUCKETS; i++)
+    {
+        seen += histogram->buckets[i];
+        if (seen >= rank)
+        {
+            // The top of bucket i is just below the bottom of bucket i + 1.
+            uint64_t top = i < 3 ? (uint64_t) i : ((uint64_t) (4 + (i + 1) % 4) << ((i + 1) / 4 - 1)) - 1;
+            return top < histogram->max ? top : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+// Prints the count, p50, p99, max and total of every metric that was timed, as a table and as JSON.
+void DumpTimings(void)
+{
+    int i;
+    bool first = true;
+    FILE* json = stderr;
+
+    fprintf(stderr, "%-14s %10s %12s %12s %12s %12s\n", "# timing", "count", "p50 us", "p99 us", "max us",
+            "total ms");
+    for (i = 0; i < NUM_OF_METRICS; i++)
+    {
+        struct Histogram* histogram = &histograms[i];
+        if (histogram->count > 0)
+        {
+            fprintf(stderr, "%-14s %10llu %12.3f %12.3f %12.3f %12.3f\n", metricNames[i],
+                    (unsigned long long) histogram->count, GetPercentile(histogram, 0.50) / 1e3,
+                    GetPercentile(histogram, 0.99) / 1e3, histogram->max / 1e3, histogram->total / 1e6);
+        }
+    }
+
+    if (strcmp(timingFilename, "-") != 0 && (json = fopen(timingFilename, "w")) == NULL)
+    {
+        fprintf(stderr, "ERROR: Failed to open filename \"%s\"\n", timingFilename);
+        return;
+    }
+    fprintf(json, "{\"unit\": \"ns\", \"metrics\": {");
+    for (i = 0; i < NUM_OF_METRICS; i++)
+    {
+        struct Histogram* histogram = &histograms[i];
+        if (histogram->count > 0)
+        {
+            fprintf(json, "%s\n  \"%s\": {\"count\": %llu, \"p50\": %llu, \"p99\": %llu, \"max\": %llu, \"total\": %llu}",
+                    first == true ? "" : ",", metricNames[i], (unsigned long long) histogram->count,
+                    (unsigned long long) GetPercentile(histogram, 0.50),
+                    (unsigned long long) GetPercentile(histogram, 0.99), (unsigned long long) histogram->max,
+                    (unsigned long long) histogram->total);
+            first = false;
+        }
+    }
+    fprintf(json, "\n}}\n");
+    if (json != stderr)
+    {
+        fclose(json);
+    }
+}
+
+// Set by -E or the ADVENTURE_STATS environment variable, see EnableStats().
+struct StatsFile* statsFile = NULL;
+char statsFilename[PATH_MAX];
+__thread struct StatsBlock* statsBlock = NULL;      // The counter block of the calling thread, claimed on first use.
+
+/* Creates the statistics file of this game in a directory and maps it into memory, so the counters can be read live
+   by advstats while the game runs. The file is removed when the program exits. */
+void EnableStats(char* dirName)
+{
+    int fd;
+    snprintf(statsFilename, sizeof(statsFilename), "%s/%s%d%s", dirName, STATS_PREFIX, (int) getpid(), STATS_SUFFIX);
+    if ((fd = open(statsFilename, O_RDWR | O_CREAT | O_TRUNC, 0644)) == -1
+        || ftruncate(fd, sizeof(struct StatsFile)) != 0
+        || (statsFile = mmap(NULL, sizeof(struct StatsFile), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+    {
+        printf("ERROR: Failed to create the statistics file \"%s\"\n", statsFilename);
+        perror("In EnableStats()");
+        exit(1);
+    }
+    close(fd);
+
+    // The file starts out zeroed, so only the header needs filling in, the magic number last.
+    struct StatsHeader* header = &statsFile->header;
+    header->version = STATS_VERSION;
+    header->numCounters = NUM_OF_COUNTERS;
+    header->pid = getpid();
+    header->startTime = time(NULL);
+    int i;
+    for (i = 0; i < NUM_OF_COUNTERS; i++)
+    {
+        snprintf(header->counterNames[i], STATS_NAME_LENGTH, "%s", counterNames[i]);
+    }
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(header->magic, STATS_MAGIC, sizeof(header->magic));
+    atexit(RemoveStats);
+}
+
+/* Adds one to a counter of the statistics file, if there is one. The calling thread is the only one writing its
+   counter block, so this is a plain increment rather than a locked one, stored whole so a reader never sees it torn.
+   Threads beyond the number of blocks share block 0, and count atomically. */
+void CountStat(enum Counters counter)
+{
+    if (statsFile == NULL)
+    {
+        return;
+    }
+    if (statsBlock == NULL)
+    {
+        uint32_t block = __atomic_add_fetch(&statsFile->header.numBlocks, 1, __ATOMIC_RELAXED);
+        statsBlock = &statsFile->blocks[block < STATS_BLOCKS ? block : 0];
+    }
+    if (statsBlock == &statsFile->blocks[0])
+    {
+        __atomic_add_fetch(&statsBlock->counts[counter], 1, __ATOMIC_RELAXED);
+    }
+    else
+    {
+        __atomic_store_n(&statsBlock->counts[counter], statsBlock->counts[counter] + 1, __ATOMIC_RELAXED);
+    }
+}
+
+// Records how long the world took to find and load in the statistics file, if there is one.
+void SetStatsLoadTime(uint64_t nanoseconds)
+{
+    if (statsFile != NULL)
+    {
+        __atomic_store_n(&statsFile->header.loadWorldNanoseconds, nanoseconds, __ATOMIC_RELAXED);
+    }
+}
+
+/* Removes the statistics file when the program exits, a game that is gone has no live counters. The mapping is left
+   for the exit to undo, as other threads may still be counting. */
+void RemoveStats(void)
+{
+    if (statsFile != NULL)
+    {
+        unlink(statsFilename);
+    }
+}
@@ -0,0 +1,251 @@
+/*************************************************************************************************************************
+ *
+ * NAME
+ *    advstats.c - the statistics reader
+ * SYNOPSIS
+ *    When compiled and run, reads the live counters of every adventure program running with -E (or ADVENTURE_STATS)
+ *    and prints them per game and in total.
+ * INSTRUCTIONS
+ *    Compile the program using this line:
+ *       gcc -o advstats advstats.c
+ *    Run the statistics reader by executing:
+ *       advstats [-i seconds] [stats-dir]
+ * DESCRIPTION
+ *    Maps every adventure.PID.stats file of the statistics directory (the current directory by default) read-only,
+ *       skipping files that are still being set up, are not statistics files, or belong to games that are no longer
+ *       running (the game removes its file when it exits, but not if it is killed). The counters of each game are the
+ *       sum of its counter blocks, one per thread (see stats.h), read without any locking: each count is read whole,
+ *       and the reader never stops or slows the game.
+ *    Prints one tab-separated line per game with its process id, uptime in seconds, the time its world took to load
+ *       in milliseconds and its counters, then a line with the counters added up over every game.
+ *    With -i, prints the counters again every interval seconds until stopped, followed each time by a line with the
+ *       rate of each counter per second since the last time.
+ * AUTHOR
+ *    Written by Andrew Swaim
+ *
+*************************************************************************************************************************/
+
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <signal.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "stats.h"
+
+#define PATH_BUFFER 1024        // Buffer for directory and file paths.
+
+// Totals struct, the counters added up over every game read.
+struct Totals
+{
+    int numGames;
+    int numCounters;            // Counters of the first game read, whose names head the table.
+    char counterNames[STATS_COUNTERS][STATS_NAME_LENGTH];
+    uint64_t counts[STATS_COUNTERS];
+};
+
+/*************************************************************************************************************************
+ * Function Declarations
+*************************************************************************************************************************/
+
+void ReadAllStats(char* dirName, struct Totals* totals);
+int ReadStatsFile(char* filename, struct Totals* totals);
+void PrintHeader(struct Totals* totals);
+void PrintTotals(struct Totals* totals, struct Totals* previous, double seconds);
+
+/*************************************************************************************************************************
+ * Main
+*************************************************************************************************************************/
+
+int main(int argc, char* argv[])
+{
+    int opt;
+    double interval = 0;
+    while ((opt = getopt(argc, argv, "i:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'i': interval = atof(optarg); break;
+            default:
+                printf("Usage: %s [-i seconds] [stats-dir]\n", argv[0]);
+                printf("  -i seconds  Print the counters again every interval seconds, with their rates.\n");
+                exit(1);
+        }
+    }
+    char* dirName = optind < argc ? argv[optind] : ".";
+
+    struct Totals totals;
+    struct Totals previous;
+    ReadAllStats(dirName, &totals);
+    PrintTotals(&totals, NULL, 0);
+
+    // Keep printing every interval, with the rates since the last time.
+    while (interval > 0)
+    {
+        struct timespec delay;
+        delay.tv_sec = (time_t) interval;
+        delay.tv_nsec = (long) ((interval - delay.tv_sec) * 1e9);
+        nanosleep(&delay, NULL);
+
+        previous = totals;
+        printf("\n");
+        ReadAllStats(dirName, &totals);
+        PrintTotals(&totals, &previous, interval);
+        fflush(stdout);
+    }
+
+    return totals.numGames > 0 ? 0 : 1;
+}
+
+/*************************************************************************************************************************
+ * Function Definitions
+*************************************************************************************************************************/
+
+// Reads the statistics file of every running game in a directory, printing a line per game and adding up the totals.
+void ReadAllStats(char* dirName, struct Totals* totals)
+{
+    DIR* dir;
+    struct dirent* dirEntry;
+    char filename[PATH_BUFFER];
+    size_t prefixLength = strlen(STATS_PREFIX);
+    size_t suffixLength = strlen(STATS_SUFFIX);
+
+    memset(totals, 0, sizeof(struct Totals));
+    if ((dir = opendir(dirName)) == NULL)
+    {
+        printf("ERROR: Failed to open the statistics directory \"%s\"\n", dirName);
+        perror("In ReadAllStats()");
+        exit(1);
+    }
+    while ((dirEntry = readdir(dir)) != NULL)
+    {
+        size_t length = strlen(dirEntry->d_name);
+        if (length > prefixLength + suffixLength && strncmp(dirEntry->d_name, STATS_PREFIX, prefixLength) == 0
+            && strcmp(dirEntry->d_name + length - suffixLength, STATS_SUFFIX) == 0)
+        {
+            snprintf(filename, sizeof(filename), "%s/%s", dirName, dirEntry->d_name);
+            totals->numGames += ReadStatsFile(filename, totals);
+        }
+    }
+    closedir(dir);
+}
+
+/* Reads the counters of one game from its statistics file, prints them and adds them to the totals. Returns 1 if
+   the game was read, and 0 if the file was skipped. */
+int ReadStatsFile(char* filename, struct Totals* totals)
+{
+    int fd;
+    struct stat fileStat;
+
+    // The file may go away at any time as its game exits.
+    if ((fd = open(filename, O_RDONLY)) == -1)
+    {
+        return 0;
+    }
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size < (off_t) sizeof(struct StatsFile))
+    {
+        close(fd);
+        return 0;
+    }
+    struct StatsFile* stats = mmap(NULL, sizeof(struct StatsFile), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (stats == MAP_FAILED)
+    {
+        return 0;
+    }
+
+    // Skip files that are not set up yet, from another version, or of a game that was killed.
+    struct StatsHeader* header = &stats->header;
+    if (memcmp(header->magic, STATS_MAGIC, sizeof(header->magic)) != 0 || header->version != STATS_VERSION
+        || header->numCounters > STATS_COUNTERS || (kill(header->pid, 0) != 0 && errno == ESRCH))
+    {
+        munmap(stats, sizeof(struct StatsFile));
+        return 0;
+    }
+
+    // The first game read names the columns, and games with other counters are left out of the totals.
+    int i, j;
+    if (totals->numGames == 0)
+    {
+        totals->numCounters = header->numCounters;
+        memcpy(totals->counterNames, header->counterNames, sizeof(totals->counterNames));
+        PrintHeader(totals);
+    }
+    if (header->numCounters != (uint32_t) totals->numCounters
+        || memcmp(header->counterNames, totals->counterNames, sizeof(totals->counterNames)) != 0)
+    {
+        munmap(stats, sizeof(struct StatsFile));
+        return 0;
+    }
+
+    // Add up the blocks of every thread.
+    uint64_t counts[STATS_COUNTERS];
+    memset(counts, 0, sizeof(counts));
+    for (i = 0; i < STATS_BLOCKS; i++)
+    {
+        for (j = 0; j < totals->numCounters; j++)
+        {
+            counts[j] += __atomic_load_n(&stats->blocks[i].counts[j], __ATOMIC_RELAXED);
+        }
+    }
+
+    printf("%d\t%lld\t%.3f", (int) header->pid, (long long) (time(NULL) - header->startTime),
+           __atomic_load_n(&header->loadWorldNanoseconds, __ATOMIC_RELAXED) / 1e6);
+    for (j = 0; j < totals->numCounters; j++)
+    {
+        printf("\t%llu", (unsigned long long) counts[j]);
+        totals->counts[j] += counts[j];
+    }
+    printf("\n");
+
+    munmap(stats, sizeof(struct StatsFile));
+    return 1;
+}
+
+// Prints the column names.
+void PrintHeader(struct Totals* totals)
+{
+    int j;
+    printf("pid\tuptime\tload_ms");
+    for (j = 0; j < totals->numCounters; j++)
+    {
+        printf("\t%s", totals->counterNames[j]);
+    }
+    printf("\n");
+}
+
+/* Prints the counters added up over every game, and with a previous reading, the rate of each counter per second
+   since then (games that exited in between take their counts with them, so a rate can drop below 0). */
+void PrintTotals(struct Totals* totals, struct Totals* previous, double seconds)
+{
+    int j;
+    if (totals->numGames == 0)
+    {
+        printf("# no running games\n");
+        return;
+    }
+    printf("# %d games", totals->numGames);
+    for (j = 0; j < totals->numCounters; j++)
+    {
+        printf("\t%s %llu", totals->counterNames[j], (unsigned long long) totals->counts[j]);
+    }
+    printf("\n");
+
+    if (previous != NULL && previous->numGames > 0 && previous->numCounters == totals->numCounters)
+    {
+        printf("# per second");
+        for (j = 0; j < totals->numCounters; j++)
+        {
+            printf("\t%s %.1f", totals->counterNames[j],
+                   ((double) totals->counts[j] - (double) previous->counts[j]) / seconds);
+        }
+        printf("\n");
+    }
+}
@@ -0,0 +1,134 @@
+/*************************************************************************************************************************
+ *
+ * NAME
+ *    bench.c - the benchmark harness shared by the room-building program and the game program
+ * SYNOPSIS
+ *    Times benchmarks, counts their allocations and compares their results with a baseline, see bench.h.
+ * INSTRUCTIONS
+ *    Compile along with buildrooms.c or adventure.c, e.g.:
+ *       gcc -o buildrooms buildrooms.c world.c bench.c -lpthread -lm
+ * DESCRIPTION
+ *    A baseline is the saved output of an earlier -B run: every line with a benchmark name, a room count, ns/op and
+ *       allocs/op is a result, and any other line (such as the column names) is skipped. A benchmark regresses when
+ *       it is more than BENCH_TOLERANCE slower than the same benchmark of the baseline, or allocates more often.
+ * AUTHOR
+ *    Written by Andrew Swaim
+ *
+*************************************************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+
+bool countAllocations = false;
+unsigned long numAllocations = 0;
+unsigned long allocatedBytes = 0;
+
+/*************************************************************************************************************************
+ * Functions
+*************************************************************************************************************************/
+
+// Reads a baseline written by an earlier benchmark run, skipping its header and any line that is not a result.
+struct Baseline* LoadBaselines(char* filename, int* numBaselines)
+{
+    FILE* file;
+    char line[BENCH_NAME_LENGTH*2];
+    int capacity = 16;
+
+    if ((file = fopen(filename, "r")) == NULL)
+    {
+        printf("ERROR: Failed to open filename \"%s\"\n", filename);
+        perror("In LoadBaselines()");
+        exit(1);
+    }
+
+    struct Baseline* baselines = malloc(sizeof(struct Baseline) * capacity);
+    *numBaselines = 0;
+    while (baselines != NULL && fgets(line, sizeof(line), file) != NULL)
+    {
+        struct Baseline* baseline = &baselines[*numBaselines];
+        if (sscanf(line, "%99[^\t]\t%d\t%lf\t%lf", baseline->name, &baseline->numRooms, &baseline->nsPerOp,
+                   &baseline->allocationsPerOp) == 4)
+        {
+            if (++*numBaselines == capacity)
+            {
+                capacity *= 2;
+                struct Baseline* grown = realloc(baselines, sizeof(struct Baseline) * capacity);
+                if (grown == NULL)
+                {
+                    free(baselines);
+                }
+                baselines = grown;
+            }
+        }
+    }
+    fclose(file);
+    if (baselines == NULL)
+    {
+        printf("ERROR: Failed to allocate %lu bytes\n", (unsigned long) (sizeof(struct Baseline) * capacity));
+        perror("In LoadBaselines()");
+        exit(1);
+    }
+
+    return baselines;
+}
+
+// Prints the column names of the benchmark results.
+void PrintBenchmarkHeader(bool hasBaseline)
+{
+    printf("benchmark\trooms\tns/op\tallocs/op\tbytes/op%s\n", hasBaseline == true ? "\tbaseline ns/op\tchange" : "");
+}
+
+// Returns true once a benchmark has run at least one operation for at least BENCH_SECONDS.
+bool IsBenchmarkDone(struct Benchmark* benchmark)
+{
+    return benchmark->numOps > 0 && benchmark->seconds >= BENCH_SECONDS;
+}
+
+// Starts timing one operation of a benchmark.
+void StartBenchmarkOp(struct Benchmark* benchmark)
+{
+    benchmark->opAllocations = numAllocations;
+    benchmark->opBytes = allocatedBytes;
+    clock_gettime(CLOCK_MONOTONIC, &benchmark->opStart);
+}
+
+// Stops timing one operation of a benchmark, adding its time and allocations to the totals.
+void StopBenchmarkOp(struct Benchmark* benchmark)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    benchmark->seconds += (now.tv_sec - benchmark->opStart.tv_sec) + (now.tv_nsec - benchmark->opStart.tv_nsec) / 1e9;
+    benchmark->allocations += numAllocations - benchmark->opAllocations;
+    benchmark->bytes += allocatedBytes - benchmark->opBytes;
+    benchmark->numOps++;
+}
+
+/* Prints the result of a benchmark, and how it compares with the same benchmark in the baseline. Returns true if it
+   is more than BENCH_TOLERANCE slower than the baseline, or allocates more often. */
+bool ReportBenchmark(struct Benchmark* benchmark, struct Baseline* baselines, int numBaselines)
+{
+    double nsPerOp = benchmark->seconds * 1e9 / benchmark->numOps;
+    double allocationsPerOp = (double) benchmark->allocations / benchmark->numOps;
+    bool regressed = false;
+    int i;
+
+    printf("%s\t%d\t%.1f\t%.1f\t%.0f", benchmark->name, benchmark->numRooms, nsPerOp, allocationsPerOp,
+           (double) benchmark->bytes / benchmark->numOps);
+    for (i = 0; i < numBaselines; i++)
+    {
+        if (strcmp(baselines[i].name, benchmark->name) == 0 && baselines[i].numRooms == benchmark->numRooms)
+        {
+            regressed = nsPerOp > baselines[i].nsPerOp * (1 + BENCH_TOLERANCE)
+                        || allocationsPerOp > baselines[i].allocationsPerOp + 0.5;
+            printf("\t%.1f\t%+.1f%%%s", baselines[i].nsPerOp, (nsPerOp / baselines[i].nsPerOp - 1) * 100,
+                   regressed == true ? " REGRESSION" : "");
+            break;
+        }
+    }
+    printf("\n");
+    fflush(stdout);
+
+    return regressed;
+}
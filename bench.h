@@ -0,0 +1,81 @@
+/*************************************************************************************************************************
+ *
+ * NAME
+ *    bench.h - the benchmark harness shared by the room-building program and the game program
+ * SYNOPSIS
+ *    Declares the benchmarks run by buildrooms -B and adventure -B, their baselines, and the allocation counters the
+ *    programs' allocation wrappers feed.
+ * INSTRUCTIONS
+ *    Include this header and compile bench.c along with the program, e.g.:
+ *       gcc -o adventure adventure.c world.c bench.c -lpthread
+ * DESCRIPTION
+ *    A program sets countAllocations once its benchmarks start, and calls CountAllocation() from its allocation
+ *       wrapper. Each benchmark is timed one operation at a time, between StartBenchmarkOp() and StopBenchmarkOp(),
+ *       until IsBenchmarkDone(), and ReportBenchmark() prints its result as a tab-separated line (see
+ *       PrintBenchmarkHeader()) and compares it with the same benchmark of a baseline read by LoadBaselines().
+ * AUTHOR
+ *    Written by Andrew Swaim
+ *
+*************************************************************************************************************************/
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <time.h>
+#include "world.h"
+
+#define BENCH_SECONDS 0.5       // Minimum time each benchmark runs for.
+#define BENCH_TOLERANCE 0.2     // Slowdown against the baseline that counts as a regression.
+#define BENCH_NAME_LENGTH 100   // Buffer for the name of a benchmark read from a baseline.
+
+// Benchmark struct, the totals of one benchmark so far.
+struct Benchmark
+{
+    char* name;
+    int numRooms;
+    unsigned long numOps;
+    double seconds;
+    unsigned long allocations;
+    unsigned long bytes;
+    struct timespec opStart;        // When the current operation started, and the allocation counts at that time.
+    unsigned long opAllocations;
+    unsigned long opBytes;
+};
+
+// Baseline struct, one result of an earlier benchmark run.
+struct Baseline
+{
+    char name[BENCH_NAME_LENGTH];
+    int numRooms;
+    double nsPerOp;
+    double allocationsPerOp;
+};
+
+/* Number and total size of the allocations made through the program's allocation wrapper, counted only while the
+   benchmarks run. */
+extern bool countAllocations;
+extern unsigned long numAllocations;
+extern unsigned long allocatedBytes;
+
+/*************************************************************************************************************************
+ * Function Declarations
+*************************************************************************************************************************/
+
+struct Baseline* LoadBaselines(char* filename, int* numBaselines);
+void PrintBenchmarkHeader(bool hasBaseline);
+bool IsBenchmarkDone(struct Benchmark* benchmark);
+void StartBenchmarkOp(struct Benchmark* benchmark);
+void StopBenchmarkOp(struct Benchmark* benchmark);
+bool ReportBenchmark(struct Benchmark* benchmark, struct Baseline* baselines, int numBaselines);
+
+// Counts an allocation of size bytes while the benchmarks run; otherwise counting costs a single flag test.
+static inline void CountAllocation(size_t size)
+{
+    if (countAllocations == true)
+    {
+        __sync_fetch_and_add(&numAllocations, 1);
+        __sync_fetch_and_add(&allocatedBytes, size);
+    }
+}
+
+#endif
@@ -1,65 +1,258 @@
 /*************************************************************************************************************************
- * 
+ *
  * NAME
  *    buildrooms.c - the room-building program
  * SYNOPSIS
- *    When compiled and run, creates a new directory and a series of files that hold descriptions of the in game rooms 
+ *    When compiled and run, creates a new directory and a series of files that hold descriptions of the in game rooms
  *    and how the rooms are connected.
  * INSTRUCTIONS
  *    Compile the program using this line:
- *       gcc -o buildrooms buildrooms.c
+ *       gcc -o buildrooms buildrooms.c world.c bench.c -lpthread -lm
  *    Run the room building program by executing:
- *       buildrooms
+ *       buildrooms [-n rooms] [-m min-connections] [-M max-connections] [-f text|binary|both]
+ *                  [-d none|world|batch] [-w worlds] [-j threads] [-o output-dir] [-g worlds-per-dir] [-s seed]
+ *                  [-k keep]
+ *       buildrooms -W walks [-n rooms] [-m min-connections] [-M max-connections] [-w worlds] [-j threads] [-s seed]
+ *       buildrooms -P pool-size [-n rooms] [-m min-connections] [-M max-connections] [-f text|binary|both]
+ *                  [-d none|world] [-o output-dir] [-s seed]
  *    NOTE: No output should be returned.
  * DESCRIPTION
  *    Creates a directory called rooms, and in that directory creates 7 different room files from 10 possible rooms:
  *       Basement_room, Attic_room, Ballroom_room, Dining_room, Kitchen_room, Library_room, Bathroom_room, Bedroom_room,
  *       Trophy_room, Study_room.
  *    Elements that make up an actual room defined inside a room file are:
- *       A Room Name (max 8 characters)
+ *       A Room Name (letters only, max 8 characters for the 10 room names above)
  *       A Room Type (START_ROOM, END_ROOM, or MID_ROOM)
  *       Outbound Connections
  *          > Between 3 to 6 outbound connections from this room to other rooms.
  *          > Outbound connections have matching connections coming back.
  *          > A room does not have an outbound connection to itself.
  *          > A room does not have more than one outbound connection to the same room.
+ *    The number of rooms and the connection bounds can be changed with the -n, -m and -M options (up to 100 million
+ *       rooms). Worlds with more rooms than there are room names use generated names (e.g. Tavoki): capitalized words
+ *       of syllables of a consonant and a vowel, with as few syllables as give every room a name of its own (2 up to
+ *       4900 rooms, one more for every 70 times as many). Room i gets the name numbered by a keyed Feistel network
+ *       permutation of i, so the names are unique by construction, spread over every possible name, and depend only
+ *       on the seed. The names are stored once in a name arena, as a length byte, the name and a null character each,
+ *       and rooms refer to them by their offset in it.
+ *    The graph is built in near-linear time: a random ring links every room to two others (which also keeps the
+ *       world connected), random pairs of free connection slots are then linked up to a random target number of
+ *       connections per room, and finally any room still below the minimum is given extra connections (taking over
+ *       links between full rooms if it has to, in a way that keeps the world connected).
+ *    Next to the room files, a small manifest file names the START_ROOM and the number of rooms, so that the
+ *       adventure program can load rooms on demand without first reading every room file.
+ *    With -f binary (or -f both) the world is also written as a single binary file, world.bin, inside the rooms
+ *       directory. The file is the world image laid out by world.c (shared with the adventure program): a header,
+ *       the connections as a compressed sparse row (CSR) array of room indexes, one byte per room for the room types,
+ *       and the room names in a pool of null-terminated strings indexed by offset. The adventure program maps this
+ *       file directly instead of parsing one text file per room.
+ *    With -w, a batch of worlds is generated across -j threads (one per core by default) into the rooms.PID.N
+ *       directories of the output directory (-o, the current directory by default), optionally grouped into numbered
+ *       subdirectories of -g worlds each.
+ *    Random numbers come from a xoshiro256** generator, seeded with -s (or from the time and process id). Bounded
+ *       numbers are drawn without modulo bias. Every world of a batch uses its own stream: world N starts from the
+ *       seeded state jumped ahead N times (2^128 numbers per jump), so streams never overlap, and a world depends only
+ *       on the seed, the options and its number - never on the number of threads. The same seed and options always
+ *       produce bit-for-bit identical room files and world.bin files.
+ *    Each world is written into a hidden staging directory (.rooms.PID, next to where the world goes) and renamed
+ *       into place once complete, so a game starting meanwhile never opens a half-written world. Every file is
+ *       formatted into one buffer and written with a single write(). With -d world, every file and directory of a
+ *       world is flushed with fsync() before the world is renamed into place, and the rename after; with -d batch
+ *       (group commit), the worlds stay staged until the whole batch is written, then one syncfs() flushes them all
+ *       before they are renamed into place, and another flushes the renames.
+ *    Once the world (or the last world of a batch) is written, the rooms.latest symbolic link in the output directory
+ *       is pointed at it. The link is created under a temporary name and renamed over the old one, so readers always
+ *       see either the previous or the new world. The adventure program follows this link instead of scanning the
+ *       directory.
+ *    With -k, only the newest keep rooms.* directories of the output directory are kept, and older ones (with the
+ *       files inside them) are removed. The worlds of a batch count as new as its newest world, and the last worlds
+ *       of the batch are kept first. The world rooms.latest points to is never removed, nor are the worlds in -g
+ *       subdirectories.
+ *    With -W, the worlds (the single world, or every world of the -w batch) are generated but not written, and walks
+ *       of a random player and a greedy player (which never goes straight back unless it has to) are simulated from
+ *       the START_ROOM to the END_ROOM of each, by the adventure program's movement rules over the same world image
+ *       it uses. The walks run in blocks across -j threads, each block with its own random number stream, and each
+ *       thread advances WALK_LANES walks side by side so their connection lookups overlap. The distribution of the
+ *       walk lengths (mean, standard deviation and percentiles) is printed per world and over all the worlds.
+ *    With -P, the program runs until stopped, keeping pool-size validated worlds ready in the pool directory of the
+ *       output directory for games started with adventure -P to claim. A world is checked before it is written, and
+ *       published into the pool with a rename like any other world. While the pool is full the program sleeps on
+ *       inotify, and replaces a world as soon as a game claims it. Worlds claimed by games that have exited, and
+ *       worlds left staged by a generator that was killed, are removed.
  * AUTHOR
  *    Written by Andrew Swaim
  *
 *************************************************************************************************************************/
 
+#define _GNU_SOURCE             // For syncfs().
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
 #include <fcntl.h>
+#include <dirent.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <pthread.h>
 #include <time.h>
+#include <math.h>
+#include "world.h"
+#include "bench.h"
 
-#define NUM_OF_ROOMS 7      // Constant to hold the number of rooms that will be created.
-#define NUM_OF_NAMES 10     // Constant to hold the total number of room names.
-#define MAX_CONNECTIONS 6   // Maximum number of connections a room can have. 
-#define MAX_CHARS 8         // Maximum number of characters for each name.
-#define STR_BUFFER 100      // General purpose buffer for string handling.
-
-// Create bool type for C89/C90 compilation.
-typedef enum { false, true } bool;
-
-// Room type enum and strings.
-enum Types { START_ROOM, MID_ROOM, END_ROOM };
-char* types[] = {"START_ROOM"
-                , "MID_ROOM"
-                , "END_ROOM"};
+#define NUM_OF_ROOMS 7          // Default number of rooms that will be created.
+#define NUM_OF_NAMES 10         // Constant to hold the total number of room names.
+#define MIN_CONNECTIONS 3       // Default minimum number of connections a room can have.
+#define MAX_CONNECTIONS 6       // Default maximum number of connections a room can have.
+#define MAX_ROOMS 100000000     // Maximum number of rooms, each with a generated name of at most 5 syllables.
+#define MAX_NAME_LENGTH 255     // Longest room name, as stored behind a one byte length in the name arena.
+#define SYLLABLE_CONSONANTS "bdfgklmnprstvz"    // Generated names are made of syllables of a consonant and a vowel.
+#define SYLLABLE_VOWELS "aeiou"
+#define NUM_OF_SYLLABLES 70     // Consonants times vowels.
+#define MIN_SYLLABLES 2         // Syllables of the shortest generated name.
+#define NAME_ROUNDS 4           // Rounds of the Feistel network that assigns the generated names, see PermuteName().
+#define MAX_RANDOM_TRIES 32     // Random picks made by AddRandomConnection() before it falls back to a scan.
+#define STR_BUFFER 100          // General purpose buffer for string handling.
+#define PATH_BUFFER 1024        // Buffer for directory and file paths.
+#define MAX_BENCH_FILES 10000   // Largest world the room file benchmark writes, as it writes one file per room.
+#define MANIFEST_FILENAME "manifest"    // Names the START_ROOM of a world of room files, must match adventure.c.
+#define WALK_LANES 64           // Walks each simulating thread advances side by side, one step each per pass.
+#define WALK_BLOCK 4096         // Walks of each player in a block, the unit of work of the simulation.
+#define WALK_LIMIT_PER_ROOM 100 // A simulated walk gives up after this many steps per room of the world.
+#define WALK_BUCKETS 464        // Histogram buckets of walk lengths: exact below 16 steps, then 16 per power of two.
+#define NO_ROOM UINT32_MAX      // Room a walk came from before its first step.
+#define ROOM_LINE_BUFFER (MAX_NAME_LENGTH + 32)  // Longest line of a room file, "CONNECTION <number>: <name>\n".
+#define POOL_RESCAN_MS 1000     // Longest the pool generator waits for a claim before checking the pool again.
 
 // Room struct.
 struct Room
 {
-    char name[MAX_CHARS+1]; // +1 for the null character.
+    uint32_t name;          // Name id: the offset of the room's name in the world's name arena, see GetArenaName().
     enum Types type;
     int numConnections;
-    char connections[MAX_CONNECTIONS][MAX_CHARS+1];
 };
 
+// World struct, holds the generation parameters and the room graph.
+struct World
+{
+    int numRooms;
+    int minConnections;
+    int maxConnections;
+    struct Room* rooms;
+    int* connections;       // Room indexes, maxConnections slots per room (row i holds the connections of room i).
+    struct Rng* rng;        // This world's random number generator.
+    char* fileText;         // Text of the room file being written, large enough for any room of the world.
+    bool syncFiles;         // Flush every file written to disk before closing it.
+    struct NameArena* names;    // The names of the rooms.
+};
+
+/* NameArena struct, the names of a world's rooms back to back in one block, each stored once as a length byte, the
+   name and a null character. A name is referred to by its id, the offset of its entry, so rooms and connections
+   carry a 4 byte id instead of a copy of the name, and writing a name needs no strlen(). */
+struct NameArena
+{
+    char* data;
+    size_t size;
+    size_t capacity;
+};
+
+// Rng struct, the state of a xoshiro256** random number generator.
+struct Rng
+{
+    uint64_t state[4];
+};
+
+// Options struct, holds the command line options.
+struct Options
+{
+    int numRooms;
+    int minConnections;
+    int maxConnections;
+    int format;             // enum Formats value.
+    int durability;         // enum Durabilities value.
+    int numWorlds;          // Number of worlds in the batch, 0 to create a single world.
+    int numThreads;
+    char* outputDir;
+    int worldsPerDir;       // Worlds per numbered subdirectory of the output directory, 0 to not group them.
+    bool hasSeed;           // True if -s was given.
+    uint64_t seed;
+    int keepWorlds;         // Number of rooms.* directories to keep in the output directory, 0 to keep them all.
+    bool benchmark;         // Run the benchmarks instead of generating worlds.
+    char* baselineFilename; // Earlier benchmark results to compare with, NULL to not compare.
+    long numWalks;          // Walks of each player to simulate through each world, 0 to write the worlds instead.
+    int poolSize;           // Worlds to keep ready in the pool, 0 to write the worlds once instead.
+};
+
+// Set by SIGINT and SIGTERM to stop the pool generator once the world it is writing is published.
+volatile sig_atomic_t stopRequested = 0;
+
+// WorldDir struct, a rooms.* directory found when pruning old worlds.
+struct WorldDir
+{
+    char name[STR_BUFFER];
+    struct timespec modified;
+    int pid;                            // Process id and batch index from the name (-1 when not in the name).
+    int index;
+    struct timespec batchModified;      // Modification time of the newest world of the same process.
+};
+
+// Batch struct, the state shared by the threads generating a batch of worlds.
+struct Batch
+{
+    struct Options* options;
+    int pid;
+    struct Rng* streams;    // Random number generator of each world, see JumpRng().
+    int nextWorld;          // Next world number to generate, taken with an atomic add.
+};
+
+// WalkStats struct, the distribution of the lengths (in steps) of a player's simulated walks.
+struct WalkStats
+{
+    uint64_t numWalks;
+    uint64_t numCapped;             // Walks that gave up before reaching the END_ROOM, counted at the step limit.
+    uint64_t sum;
+    double sumSquares;
+    uint32_t min;
+    uint32_t max;
+    uint64_t buckets[WALK_BUCKETS]; // See GetWalkBucket().
+};
+
+// Simulation struct, the state shared by the threads simulating walks through one world.
+struct Simulation
+{
+    struct WorldImage* image;       // The world, laid out as the adventure program holds it in memory.
+    uint32_t stepLimit;             // Steps after which a walk gives up, at most UINT32_MAX.
+    long numWalks;                  // Walks of each player.
+    int numBlocks;
+    uint64_t* seeds;                // Seed of the random number generator of each block of walks.
+    int nextBlock;                  // Next block to simulate, taken with an atomic add.
+};
+
+// Walker struct, one thread simulating walks, and the distributions of the walks it simulated.
+struct Walker
+{
+    struct Simulation* simulation;
+    struct WalkStats stats[2];      // One per enum Players value.
+    pthread_t thread;
+};
+
+// Simulated players. The random player moves to any connected room, and the greedy player never goes straight back
+// to the room it came from unless it has no other choice.
+enum Players { RANDOM_PLAYER, GREEDY_PLAYER, NUM_PLAYERS };
+char* players[] = {"random", "greedy"};
+
+// Output formats for the generated world.
+enum Formats { TEXT_FORMAT = 1, BINARY_FORMAT = 2, BOTH_FORMATS = 3 };
+
+/* How the worlds are made durable before they are published: not at all (the kernel writes them back in its own
+   time), every file and directory of each world before it is published, or the whole batch at once with syncfs(). */
+enum Durabilities { NO_SYNC, WORLD_SYNC, BATCH_SYNC };
+
 // Room names.
 char* names[] = {"Basement"
                 , "Attic"
@@ -76,212 +269,2011 @@ char* names[] = {"Basement"
  * Function Declarations
 *************************************************************************************************************************/
 
-void InitRooms(struct Room rooms[]);
-void Shuffle(int arr[], int n);
-void MakeRoomFile(struct Room* room, char* dir);
-bool IsGraphFull();
-void AddRandomConnection(struct Room rooms[]);
-bool ConnectionAlreadyExists(struct Room* roomA, struct Room* roomB);
+void ParseArgs(int argc, char* argv[], struct Options* options);
+void PrintUsage(char* program);
+void* SafeMalloc(size_t size);
+int RunSimulation(struct Options* options);
+void* SimulateWalks(void* walker);
+void RunWalks(struct Simulation* simulation, int player, struct Rng* rng, int count, struct WalkStats* stats);
+uint32_t FindShortestPath(struct WorldImage* image);
+void InitWalkStats(struct WalkStats* stats);
+void AddWalk(struct WalkStats* stats, uint32_t steps, bool capped);
+void MergeWalkStats(struct WalkStats* into, struct WalkStats* from);
+int GetWalkBucket(uint32_t steps);
+uint32_t GetPercentile(struct WalkStats* stats, double fraction);
+void PrintWalkStats(char* world, int player, struct WalkStats* stats, char* shortest);
+int RunBenchmarks(struct Options* options);
+int RunPool(struct Options* options);
+int ScanPool(char* poolDir);
+void HandleStopSignal(int signalNumber);
+bool ValidateWorld(struct World* world, char problem[]);
+bool GenerateWorld(struct World* world, struct Options* options, char* dirName);
+void* GenerateWorlds(void* batch);
+void GetWorldDirName(struct Options* options, int pid, int index, char* dirName);
+void GetStagingDirName(char* dirName, char* stagingName);
+void PublishWorld(char* stagingName, char* dirName, bool sync);
+void CommitBatch(struct Options* options, int pid);
+void WriteWholeFile(char* filename, const char* data, size_t size, bool sync);
+void SyncFileSystem(char* path);
+void MakeDir(char* dirName);
+void PublishLatest(char* outputDir, char* target, bool sync);
+void PruneWorlds(char* outputDir, int keepWorlds);
+int CompareWorldDirs(const void* a, const void* b);
+int CompareWorldBatches(const void* a, const void* b);
+void RemoveWorldDir(char* dirName);
+void InitWorld(struct World* world, struct Options* options);
+void FreeWorld(struct World* world);
+void InitRooms(struct World* world);
+void GenerateNames(struct World* world);
+uint64_t PermuteName(uint64_t index, uint64_t numNames, int halfBits, const uint64_t keys[]);
+int GetNumSyllables(int numRooms);
+uint32_t AddName(struct NameArena* arena, const char* name, size_t length);
+const char* GetArenaName(struct NameArena* arena, uint32_t id);
+size_t GetArenaNameLength(struct NameArena* arena, uint32_t id);
+uint64_t MixBits(uint64_t z);
+void SeedRng(struct Rng* rng, uint64_t seed);
+uint64_t NextRandom(struct Rng* rng);
+void JumpRng(struct Rng* rng);
+int RandomInt(struct Rng* rng, int n);
+void Shuffle(int arr[], int n, struct Rng* rng);
+void BuildGraph(struct World* world);
+void MakeRoomFile(struct World* world, int index, char* dir);
+size_t FormatRoomLine(char* line, const char* key, int number, const char* value, size_t valueLength);
+void MakeManifestFile(struct World* world, char* dir);
+bool IsGraphFull(struct World* world);
+void AddRandomConnection(struct World* world, int indexA);
+bool CanConnect(struct World* world, int indexA, int indexB);
+void ConnectRooms(struct World* world, int indexA, int indexB);
+void DisconnectRooms(struct World* world, int indexA, int indexB);
+bool ConnectionAlreadyExists(struct World* world, int indexA, int indexB);
+void MakeWorldFile(struct World* world, char* dir);
+void FillWorldImage(struct World* world, struct WorldImage* image);
 
 /*************************************************************************************************************************
- * Main 
+ * Main
 *************************************************************************************************************************/
 
-int main()
+int main(int argc, char* argv[])
 {
-    // Seed the random number generator.
-    unsigned seed = time(0);
-    srand(seed);
+    // Get the world parameters.
+    struct Options options;
+    ParseArgs(argc, argv, &options);
 
-    // Create the rooms.
-    struct Room rooms[NUM_OF_ROOMS];
-    
-    // Initialize the rooms
-    InitRooms(rooms);
-    
-    // Create all connections in graph.
-    while (IsGraphFull(rooms) == false)
+    // Run the benchmarks instead, if asked to.
+    if (options.benchmark == true)
+    {
+        return RunBenchmarks(&options);
+    }
+
+    // Simulate walks through the worlds instead, if asked to.
+    if (options.numWalks > 0)
+    {
+        return RunSimulation(&options);
+    }
+
+    // Or keep the pool of ready worlds full until stopped.
+    if (options.poolSize > 0)
     {
-      AddRandomConnection(rooms);
+        return RunPool(&options);
     }
 
     // Get the current process id.
     int pid = getpid();
-    
-    // Variables for creating the directory.
-    char dirName[STR_BUFFER];
 
-    // Initialize the buffer and concat the prefix and proccess id into the buffer.
-    memset(dirName, '\0', STR_BUFFER);
-    snprintf(dirName, sizeof(dirName), "rooms.%d", pid); 
+    // Seed the random number generator, from the time and process id unless a seed was given.
+    struct Rng rng;
+    SeedRng(&rng, options.hasSeed == true ? options.seed : (uint64_t) time(0) ^ ((uint64_t) pid << 32));
 
-    // Create the directory.
-    mkdir(dirName, 0755);
+    // Create the output directory if it does not exist yet.
+    MakeDir(options.outputDir);
 
-    int i;
-    for (i = 0; i < NUM_OF_ROOMS; i++)
+    // Name of the newest world, relative to the output directory.
+    char latest[PATH_BUFFER];
+
+    if (options.numWorlds == 0)
+    {
+        // Variables for creating the directory.
+        char dirName[PATH_BUFFER];
+        GetWorldDirName(&options, pid, -1, dirName);
+
+        // Create the rooms.
+        struct World world;
+        InitWorld(&world, &options);
+        world.rng = &rng;
+        GenerateWorld(&world, &options, dirName);
+        FreeWorld(&world);
+
+        snprintf(latest, sizeof(latest), "rooms.%d", pid);
+    }
+    else
+    {
+        // Give world N the stream jumped ahead N times, so worlds do not depend on which thread generates them.
+        int i;
+        struct Rng* streams = SafeMalloc(sizeof(struct Rng) * options.numWorlds);
+        for (i = 0; i < options.numWorlds; i++)
+        {
+            streams[i] = rng;
+            JumpRng(&rng);
+        }
+
+        // Generate the batch of worlds across the threads.
+        struct Batch batch;
+        batch.options = &options;
+        batch.pid = pid;
+        batch.streams = streams;
+        batch.nextWorld = 0;
+
+        pthread_t* threads = SafeMalloc(sizeof(pthread_t) * options.numThreads);
+        for (i = 0; i < options.numThreads; i++)
+        {
+            if ((pthread_create(&threads[i], NULL, GenerateWorlds, (void*) &batch)) != 0)
+            {
+                printf("ERROR: There was a problem creating a thread\n");
+                perror("In main() with pthread_create()");
+                exit(1);
+            }
+        }
+        for (i = 0; i < options.numThreads; i++)
+        {
+            pthread_join(threads[i], NULL);
+        }
+        free(threads);
+        free(streams);
+
+        // The last world of the batch becomes the newest world.
+        i = options.numWorlds - 1;
+        if (options.worldsPerDir > 0)
+        {
+            snprintf(latest, sizeof(latest), "%d/rooms.%d.%d", i / options.worldsPerDir, pid, i);
+        }
+        else
+        {
+            snprintf(latest, sizeof(latest), "rooms.%d.%d", pid, i);
+        }
+    }
+
+    // With group commit, the worlds are all still staged: make them durable and publish them together.
+    if (options.durability == BATCH_SYNC)
     {
-        MakeRoomFile(&rooms[i], dirName);
-    }    
+        CommitBatch(&options, pid);
+    }
+
+    // Point the latest link at the new world, then remove the worlds past the retention limit.
+    PublishLatest(options.outputDir, latest, options.durability != NO_SYNC);
+    if (options.keepWorlds > 0)
+    {
+        PruneWorlds(options.outputDir, options.keepWorlds);
+    }
 
     return 0;
 }
 
 /*************************************************************************************************************************
- * Function Definitions 
+ * Function Definitions
 *************************************************************************************************************************/
 
-// Initializes the array of rooms.
-void InitRooms(struct Room rooms[])
+// Reads the command line options, and checks that a valid graph can be built from them.
+void ParseArgs(int argc, char* argv[], struct Options* options)
 {
-    // Indexes for shuffling in order to randomly select room names.
-    int indexes[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
-    
-    // Shuffle array of indexes.
-    Shuffle(indexes, NUM_OF_NAMES);
+    int opt;
 
-    /* Assign names randomly using the shuffled indexes, 
-       initialize numConnections, and assign room types */
-    int i;
-    for (i = 0; i < NUM_OF_ROOMS; i++)
+    // Default to the classic 7 room world.
+    options->numRooms = NUM_OF_ROOMS;
+    options->minConnections = MIN_CONNECTIONS;
+    options->maxConnections = MAX_CONNECTIONS;
+    options->format = TEXT_FORMAT;
+    options->durability = NO_SYNC;
+    options->numWorlds = 0;
+    options->numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+    options->outputDir = ".";
+    options->worldsPerDir = 0;
+    options->hasSeed = false;
+    options->keepWorlds = 0;
+    options->benchmark = false;
+    options->baselineFilename = NULL;
+    options->numWalks = 0;
+    options->poolSize = 0;
+
+    while ((opt = getopt(argc, argv, "n:m:M:f:d:w:j:o:g:s:k:Bb:W:P:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'n': options->numRooms = atoi(optarg); break;
+            case 'm': options->minConnections = atoi(optarg); break;
+            case 'M': options->maxConnections = atoi(optarg); break;
+            case 'f':
+                if (strcmp(optarg, "text") == 0)
+                    options->format = TEXT_FORMAT;
+                else if (strcmp(optarg, "binary") == 0)
+                    options->format = BINARY_FORMAT;
+                else if (strcmp(optarg, "both") == 0)
+                    options->format = BOTH_FORMATS;
+                else
+                {
+                    PrintUsage(argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'd':
+                if (strcmp(optarg, "none") == 0)
+                    options->durability = NO_SYNC;
+                else if (strcmp(optarg, "world") == 0)
+                    options->durability = WORLD_SYNC;
+                else if (strcmp(optarg, "batch") == 0)
+                    options->durability = BATCH_SYNC;
+                else
+                {
+                    PrintUsage(argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'w': options->numWorlds = atoi(optarg); break;
+            case 'j': options->numThreads = atoi(optarg); break;
+            case 'o': options->outputDir = optarg; break;
+            case 'g': options->worldsPerDir = atoi(optarg); break;
+            case 's': options->hasSeed = true; options->seed = strtoull(optarg, NULL, 0); break;
+            case 'k': options->keepWorlds = atoi(optarg); break;
+            case 'B': options->benchmark = true; break;
+            case 'b': options->benchmark = true; options->baselineFilename = optarg; break;
+            case 'W': options->numWalks = atol(optarg); break;
+            case 'P': options->poolSize = atoi(optarg); break;
+            default: PrintUsage(argv[0]); exit(1);
+        }
+    }
+
+    // Every room needs two links for the ring, and cannot link to more rooms than there are other rooms.
+    if (options->numRooms < 3 || options->numRooms > MAX_ROOMS)
+    {
+        printf("ERROR: The number of rooms must be between 3 and %d\n", MAX_ROOMS);
+        exit(1);
+    }
+    if (options->minConnections < 2 || options->minConnections > options->maxConnections
+        || options->maxConnections > options->numRooms - 1)
+    {
+        printf("ERROR: Connection bounds must satisfy 2 <= min <= max <= rooms - 1\n");
+        exit(1);
+    }
+
+    // The connection slots of every room are indexed by int.
+    if ((long long) options->numRooms * options->maxConnections > INT_MAX)
+    {
+        printf("ERROR: Too many connection slots, lower the number of rooms or the maximum connections\n");
+        exit(1);
+    }
+
+    // Every connection has a matching connection coming back, so the total number of connections is even.
+    if (options->minConnections == options->maxConnections && options->minConnections % 2 == 1
+        && options->numRooms % 2 == 1)
+    {
+        printf("ERROR: An odd number of rooms cannot all have exactly %d connections\n", options->minConnections);
+        exit(1);
+    }
+
+    if (options->numWorlds < 0 || options->numThreads < 1 || options->worldsPerDir < 0 || options->keepWorlds < 0)
+    {
+        printf("ERROR: The number of worlds, threads, worlds per directory and worlds to keep cannot be negative or "
+               "0 threads\n");
+        exit(1);
+    }
+
+    if (options->numWalks < 0 || (options->numWalks > 0 && options->benchmark == true))
     {
-        strcpy(rooms[i].name, names[indexes[i]]);
-        rooms[i].numConnections = 0;
-        rooms[i].type = MID_ROOM;
+        printf("ERROR: The number of walks cannot be negative, and -W cannot be combined with -B\n");
+        exit(1);
     }
 
-    // Re-assign the room types for the first and last room.
-    rooms[0].type = START_ROOM;
-    rooms[6].type = END_ROOM;
+    // The pool generator writes one world at a time into the pool, and publishes each one as soon as it is written.
+    if (options->poolSize < 0 || (options->poolSize > 0 && (options->benchmark == true || options->numWalks > 0
+                                                            || options->numWorlds > 0 || options->keepWorlds > 0
+                                                            || options->durability == BATCH_SYNC)))
+    {
+        printf("ERROR: The pool size cannot be negative, and -P cannot be combined with -B, -W, -w, -k or -d batch\n");
+        exit(1);
+    }
 }
 
-// Shuffles an array of integers using the Fisher-Yates shuffle algorithm.
-void Shuffle(int arr[], int n)
+// Prints the command line options.
+void PrintUsage(char* program)
 {
-   int i, j, tmp;   // Index variables.
-   
-   for (i = n-1 ; i > 0; i--)
-   {
-        // Get a random index.
-        j = rand() % i;
-
-        // Swap the current index with the random index.
-        tmp = arr[i];
-        arr[i] = arr[j];
-        arr[j] = tmp;
-   }
+    printf("Usage: %s [-n rooms] [-m min-connections] [-M max-connections] [-f text|binary|both]\n", program);
+    printf("       %*s [-d none|world|batch] [-w worlds] [-j threads] [-o output-dir] [-g worlds-per-dir]\n",
+           (int) strlen(program), "");
+    printf("       %*s [-s seed] [-k keep]\n", (int) strlen(program), "");
+    printf("       %s -B [-b baseline] [-m min-connections] [-M max-connections] [-o output-dir]\n", program);
+    printf("       %s -W walks [-n rooms] [-m min-connections] [-M max-connections] [-w worlds] [-j threads]\n",
+           program);
+    printf("       %*s [-s seed]\n", (int) strlen(program), "");
+    printf("       %s -P pool-size [-n rooms] [-m min-connections] [-M max-connections] [-f text|binary|both]\n",
+           program);
+    printf("       %*s [-d none|world] [-o output-dir] [-s seed]\n", (int) strlen(program), "");
+    printf("  -n rooms            Number of rooms to create (default %d).\n", NUM_OF_ROOMS);
+    printf("  -m min-connections  Minimum connections per room (default %d).\n", MIN_CONNECTIONS);
+    printf("  -M max-connections  Maximum connections per room (default %d).\n", MAX_CONNECTIONS);
+    printf("  -f format           Write one text file per room, a single binary %s, or both (default text).\n",
+           WORLD_FILENAME);
+    printf("  -d durability       Flush nothing to disk (none, the default), each world before it is published\n");
+    printf("                      (world), or the whole batch at once before it is published (batch).\n");
+    printf("  -w worlds           Generate a batch of worlds named rooms.PID.N instead of a single rooms.PID.\n");
+    printf("  -j threads          Number of threads generating the batch (default one per core).\n");
+    printf("  -o output-dir       Directory to create the worlds in (default the current directory).\n");
+    printf("  -g worlds-per-dir   Group the batch into numbered subdirectories of this many worlds each.\n");
+    printf("  -s seed             Seed the random number generator, making the worlds reproducible.\n");
+    printf("  -k keep             Keep only the newest keep rooms.* directories of the output directory (worlds in\n");
+    printf("                      -g subdirectories are never removed).\n");
+    printf("  -B                  Benchmark graph construction and file writing instead of generating worlds.\n");
+    printf("  -b baseline         Benchmark, and compare with the results of an earlier -B run saved to a file.\n");
+    printf("  -W walks            Simulate this many walks of a random and a greedy player through each world (or\n");
+    printf("                      each world of the -w batch) from START_ROOM to END_ROOM instead of writing it,\n");
+    printf("                      and print the distribution of their lengths in steps.\n");
+    printf("  -P pool-size        Keep this many validated worlds ready in the %s directory of the output directory\n",
+           POOL_DIRNAME);
+    printf("                      for adventure -P to claim, until stopped with SIGINT or SIGTERM.\n");
 }
 
-// Creates a room file.
-void MakeRoomFile(struct Room* room, char* dir)
+/* Times graph construction, room file writing and world file writing for a range of world sizes, printing the time
+   and allocations per operation of each, and compares them with a baseline (the output of an earlier run) if one is
+   given. Returns 0, or 1 if any benchmark regressed against the baseline. */
+int RunBenchmarks(struct Options* options)
 {
-    FILE* file;
+    int sizes[] = {NUM_OF_ROOMS, 1000, 100000, 1000000};
+    int numSizes = sizeof(sizes) / sizeof(sizes[0]);
+    char dirName[PATH_BUFFER];
+    int i, j, numBaselines = 0;
+    bool regressed = false;
 
-    // Buffer to hold the filename.
-    char filename[STR_BUFFER];
-    memset(filename, '\0', STR_BUFFER);
+    struct Baseline* baselines = options->baselineFilename != NULL
+                                 ? LoadBaselines(options->baselineFilename, &numBaselines) : NULL;
+    PrintBenchmarkHeader(baselines != NULL);
+    countAllocations = true;
 
-    // Create the filename.
-    snprintf(filename, sizeof(filename), "%s/%s_room", dir, room->name);
+    // Every benchmark writes into (and then empties) one scratch rooms directory.
+    snprintf(dirName, sizeof(dirName), "%s/rooms.bench.%d", options->outputDir, (int) getpid());
+    MakeDir(options->outputDir);
 
-    // Open the file for writing.
-    if ((file = fopen(filename, "w")) == NULL)
+    struct Rng rng;
+    SeedRng(&rng, options->hasSeed == true ? options->seed : 1);
+
+    for (i = 0; i < numSizes; i++)
     {
-        printf("ERROR: Failed to open filename \"%s\"\n", filename);
-        perror("In MakeRoomFile()");
+        // Skip the sizes the connection bounds cannot make a world of (see ParseArgs()).
+        if (options->maxConnections > sizes[i] - 1 || (options->minConnections == options->maxConnections
+                                                       && options->minConnections % 2 == 1 && sizes[i] % 2 == 1))
+        {
+            continue;
+        }
+
+        struct Options worldOptions = *options;
+        worldOptions.numRooms = sizes[i];
+        struct World world;
+        InitWorld(&world, &worldOptions);
+        world.rng = &rng;
+
+        // Graph construction: the rooms and every connection between them.
+        struct Benchmark benchmark = {.name = "build_graph", .numRooms = sizes[i]};
+        while (IsBenchmarkDone(&benchmark) == false)
+        {
+            StartBenchmarkOp(&benchmark);
+            InitRooms(&world);
+            BuildGraph(&world);
+            StopBenchmarkOp(&benchmark);
+        }
+        regressed |= ReportBenchmark(&benchmark, baselines, numBaselines);
+
+        // Room file writing: one text file per room, so only for the smaller worlds.
+        if (sizes[i] <= MAX_BENCH_FILES)
+        {
+            benchmark = (struct Benchmark) {.name = "room_files", .numRooms = sizes[i]};
+            while (IsBenchmarkDone(&benchmark) == false)
+            {
+                MakeDir(dirName);
+                StartBenchmarkOp(&benchmark);
+                for (j = 0; j < world.numRooms; j++)
+                {
+                    MakeRoomFile(&world, j, dirName);
+                }
+                StopBenchmarkOp(&benchmark);
+                RemoveWorldDir(dirName);
+            }
+            regressed |= ReportBenchmark(&benchmark, baselines, numBaselines);
+        }
+
+        // World file writing: the whole world as one binary file.
+        benchmark = (struct Benchmark) {.name = "world_file", .numRooms = sizes[i]};
+        while (IsBenchmarkDone(&benchmark) == false)
+        {
+            MakeDir(dirName);
+            StartBenchmarkOp(&benchmark);
+            MakeWorldFile(&world, dirName);
+            StopBenchmarkOp(&benchmark);
+            RemoveWorldDir(dirName);
+        }
+        regressed |= ReportBenchmark(&benchmark, baselines, numBaselines);
+
+        FreeWorld(&world);
+    }
+
+    free(baselines);
+    return regressed == true ? 1 : 0;
+}
+
+/* Allocates memory, exiting the program if the allocation fails. While the benchmarks run, every allocation is
+   counted (see bench.h). */
+void* SafeMalloc(size_t size)
+{
+    CountAllocation(size);
+    void* ptr = malloc(size);
+    if (ptr == NULL && size > 0)
+    {
+        printf("ERROR: Failed to allocate %lu bytes\n", (unsigned long) size);
+        perror("In SafeMalloc()");
         exit(1);
     }
+    return ptr;
+}
 
-    // Create a line to write.
-    char fileLine[STR_BUFFER];
-    memset(fileLine, '\0', STR_BUFFER);
-    snprintf(fileLine, sizeof(fileLine), "ROOM NAME: %s\n", room->name);
+/* Generates the worlds the same options would write (a single world, or the -w batch, which -s makes the same worlds
+   bit for bit), and simulates walks of each player from the START_ROOM to the END_ROOM of each one instead of writing
+   it. The walks move by the adventure program's rules, one connection per step, and the distribution of their lengths
+   is printed per world and over all the worlds as tab-separated lines. Returns 0. */
+int RunSimulation(struct Options* options)
+{
+    int numWorlds = options->numWorlds == 0 ? 1 : options->numWorlds;
+    struct WalkStats totals[NUM_PLAYERS];
+    struct timespec started, finished;
+    char worldName[STR_BUFFER];
+    char shortest[STR_BUFFER];
+    double totalShortest = 0;
+    int i, j, player;
 
-    // Write room name line.
-    fputs(fileLine, file);
+    // Seed the random number generator the way main() does.
+    struct Rng rng;
+    SeedRng(&rng, options->hasSeed == true ? options->seed : (uint64_t) time(0) ^ ((uint64_t) getpid() << 32));
 
-    // Write the room connections.
-    int i;
-    char* text = "CONNECTION";
-    for (i = 1; i <= room->numConnections; i++)
+    for (player = 0; player < NUM_PLAYERS; player++)
+    {
+        InitWalkStats(&totals[player]);
+    }
+    printf("# %d world%s of %d rooms with %d to %d connections, %ld walks per player per world\n", numWorlds,
+           numWorlds == 1 ? "" : "s", options->numRooms, options->minConnections, options->maxConnections,
+           options->numWalks);
+    printf("world\tplayer\twalks\tmean\tstddev\tmin\tp50\tp90\tp99\tmax\tcapped\tshortest\n");
+    fflush(stdout);
+    clock_gettime(CLOCK_MONOTONIC, &started);
+
+    struct World world;
+    InitWorld(&world, options);
+    struct Simulation simulation;
+    simulation.numWalks = options->numWalks;
+    simulation.numBlocks = (options->numWalks + WALK_BLOCK - 1) / WALK_BLOCK;
+    simulation.seeds = SafeMalloc(sizeof(uint64_t) * simulation.numBlocks);
+    int numThreads = options->numThreads < simulation.numBlocks ? options->numThreads : simulation.numBlocks;
+    struct Walker* walkers = SafeMalloc(sizeof(struct Walker) * numThreads);
+
+    for (i = 0; i < numWorlds; i++)
     {
-        // Reset the write buffer.
-        memset(fileLine, '\0', STR_BUFFER);
+        // World N uses the stream jumped ahead N times, as in a batch, and its rooms are laid out as a world image.
+        struct Rng stream = rng;
+        JumpRng(&rng);
+        world.rng = &stream;
+        InitRooms(&world);
+        BuildGraph(&world);
+        struct WorldImage image;
+        FillWorldImage(&world, &image);
+
+        // The blocks of walks take their seeds from the world's stream, so the walks do not depend on the threads.
+        simulation.image = &image;
+        uint64_t stepLimit = (uint64_t) world.numRooms * WALK_LIMIT_PER_ROOM;
+        simulation.stepLimit = stepLimit > UINT32_MAX ? UINT32_MAX : (uint32_t) stepLimit;
+        simulation.nextBlock = 0;
+        for (j = 0; j < simulation.numBlocks; j++)
+        {
+            simulation.seeds[j] = NextRandom(&stream);
+        }
 
-        // Create a line for writing.
-        snprintf(fileLine, sizeof(fileLine), "%s %d: %s\n", text, i, room->connections[i-1]);
+        // Simulate the blocks across the threads, the calling thread being the first walker.
+        for (j = 0; j < numThreads; j++)
+        {
+            walkers[j].simulation = &simulation;
+            if (j > 0 && pthread_create(&walkers[j].thread, NULL, SimulateWalks, &walkers[j]) != 0)
+            {
+                printf("ERROR: There was a problem creating a thread\n");
+                perror("In RunSimulation() with pthread_create()");
+                exit(1);
+            }
+        }
+        SimulateWalks(&walkers[0]);
+        for (j = 1; j < numThreads; j++)
+        {
+            pthread_join(walkers[j].thread, NULL);
+        }
 
-        // Write to file.
-        fputs(fileLine, file);
+        // Report the world, and add it to the totals.
+        uint32_t distance = FindShortestPath(&image);
+        totalShortest += distance;
+        snprintf(worldName, sizeof(worldName), "%d", i);
+        snprintf(shortest, sizeof(shortest), "%u", distance);
+        for (player = 0; player < NUM_PLAYERS; player++)
+        {
+            struct WalkStats stats;
+            InitWalkStats(&stats);
+            for (j = 0; j < numThreads; j++)
+            {
+                MergeWalkStats(&stats, &walkers[j].stats[player]);
+            }
+            PrintWalkStats(worldName, player, &stats, shortest);
+            MergeWalkStats(&totals[player], &stats);
+        }
+        free(image.data);
     }
 
-    // Write the room type to a file.
-    memset(fileLine, '\0', STR_BUFFER);
-    snprintf(fileLine, sizeof(fileLine), "ROOM TYPE: %s\n", types[room->type]);
-    fputs(fileLine, file);
+    // Report all the worlds together, with the mean shortest path.
+    snprintf(shortest, sizeof(shortest), "%.1f", totalShortest / numWorlds);
+    for (player = 0; player < NUM_PLAYERS; player++)
+    {
+        PrintWalkStats("all", player, &totals[player], shortest);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &finished);
+    double seconds = (finished.tv_sec - started.tv_sec) + (finished.tv_nsec - started.tv_nsec) / 1e9;
+    double numSteps = (double) (totals[RANDOM_PLAYER].sum + totals[GREEDY_PLAYER].sum);
+    printf("# %.0f steps in %.3f seconds (%.0f steps/s) on %d thread%s\n", numSteps, seconds, numSteps / seconds,
+           numThreads, numThreads == 1 ? "" : "s");
 
-    fclose(file);
+    FreeWorld(&world);
+    free(simulation.seeds);
+    free(walkers);
+    return 0;
 }
 
-// Returns true if all rooms have 3 to 6 outbound connections, false otherwise.
-bool IsGraphFull(struct Room rooms[])
+// Runs in each thread of a simulation, simulating blocks of walks until every block has been taken.
+void* SimulateWalks(void* arg)
 {
-    int i;
-    for (i = 0; i < NUM_OF_ROOMS; i++) 
+    struct Walker* walker = arg;
+    struct Simulation* simulation = walker->simulation;
+    struct Rng rng;
+    int block, player;
+
+    for (player = 0; player < NUM_PLAYERS; player++)
+    {
+        InitWalkStats(&walker->stats[player]);
+    }
+    while ((block = __sync_fetch_and_add(&simulation->nextBlock, 1)) < simulation->numBlocks)
     {
-        if (rooms[i].numConnections < 3)
+        // Each block has its own random number stream, and holds WALK_BLOCK walks of each player (fewer in the last).
+        long remaining = simulation->numWalks - (long) block * WALK_BLOCK;
+        int count = remaining < WALK_BLOCK ? remaining : WALK_BLOCK;
+        SeedRng(&rng, simulation->seeds[block]);
+        for (player = 0; player < NUM_PLAYERS; player++)
         {
-            return false;
+            RunWalks(simulation, player, &rng, count, &walker->stats[player]);
         }
     }
-    return true;
+
+    return NULL;
 }
 
-// Adds a random, valid outbound connection from a Room to another Room.
-void AddRandomConnection(struct Room rooms[])
+/* Simulates count walks of a player from the START_ROOM until they reach the END_ROOM (or the step limit). The walks
+   are kept as a structure of arrays, WALK_LANES of them side by side, and each pass moves every walk one step: the
+   walks are independent, so the lookups of their connections overlap instead of waiting on each other, and the loop
+   has no branches beyond the player's pick. A finished walk's lane starts the next walk, and once none are left the
+   lanes are retired by moving the last lane into them. */
+void RunWalks(struct Simulation* simulation, int player, struct Rng* rng, int count, struct WalkStats* stats)
 {
-    // To hold the indexes and pointers to the rooms.
-    int indexA, indexB;
-    struct Room *roomA, *roomB;
+    const uint32_t* linkOffsets = simulation->image->linkOffsets;
+    const uint32_t* links = simulation->image->links;
+    uint32_t startRoom = simulation->image->startRoom;
+    uint32_t endRoom = simulation->image->endRoom;
+    uint32_t stepLimit = simulation->stepLimit;
+    uint32_t current[WALK_LANES];
+    uint32_t previous[WALK_LANES];
+    uint32_t steps[WALK_LANES];
+    int numLanes = count < WALK_LANES ? count : WALK_LANES;
+    int numStarted = numLanes;
+    int lane;
+
+    for (lane = 0; lane < numLanes; lane++)
+    {
+        current[lane] = startRoom;
+        previous[lane] = NO_ROOM;
+        steps[lane] = 0;
+    }
 
-    while(1)
+    while (numLanes > 0)
     {
-        // Keep selecting a random room index until one that is not full is selected.
-        indexA = rand() % NUM_OF_ROOMS;
-        roomA = &rooms[indexA];
-        if (roomA->numConnections < 6) 
+        // Move every walk to a random connection. The greedy player picks among the connections other than the one
+        // it came from, with the last connection standing in for that one if it is picked.
+        for (lane = 0; lane < numLanes; lane++)
         {
-            break;
+            uint32_t room = current[lane];
+            uint32_t first = linkOffsets[room];
+            uint32_t numConnections = linkOffsets[room+1] - first;
+            uint32_t avoid = player == GREEDY_PLAYER ? previous[lane] : NO_ROOM;
+            uint32_t next = links[first + RandomInt(rng, numConnections - (avoid != NO_ROOM))];
+            if (next == avoid)
+            {
+                next = links[first + numConnections - 1];
+            }
+            previous[lane] = room;
+            current[lane] = next;
+            steps[lane]++;
+        }
+
+        // Record the walks that are over, and start the next walks in their lanes or retire the lanes.
+        for (lane = numLanes - 1; lane >= 0; lane--)
+        {
+            if (current[lane] == endRoom || steps[lane] == stepLimit)
+            {
+                AddWalk(stats, steps[lane], current[lane] != endRoom);
+                if (numStarted < count)
+                {
+                    current[lane] = startRoom;
+                    previous[lane] = NO_ROOM;
+                    steps[lane] = 0;
+                    numStarted++;
+                }
+                else
+                {
+                    numLanes--;
+                    current[lane] = current[numLanes];
+                    previous[lane] = previous[numLanes];
+                    steps[lane] = steps[numLanes];
+                }
+            }
         }
     }
+}
 
-    do
+// Returns the fewest steps from the START_ROOM to the END_ROOM of a world, found with a breadth-first search.
+uint32_t FindShortestPath(struct WorldImage* image)
+{
+    uint32_t* distances = SafeMalloc(sizeof(uint32_t) * image->numRooms);
+    uint32_t* queue = SafeMalloc(sizeof(uint32_t) * image->numRooms);
+    uint32_t head = 0, tail = 0;
+    uint32_t i;
+
+    for (i = 0; i < image->numRooms; i++)
+    {
+        distances[i] = NO_ROOM;
+    }
+    distances[image->startRoom] = 0;
+    queue[tail++] = image->startRoom;
+    while (head < tail && distances[image->endRoom] == NO_ROOM)
     {
-        // Keep selecting another random room until a valid selection is made.
-        indexB = rand() % NUM_OF_ROOMS;
-        roomB = &rooms[indexB];
+        uint32_t room = queue[head++];
+        for (i = image->linkOffsets[room]; i < image->linkOffsets[room+1]; i++)
+        {
+            if (distances[image->links[i]] == NO_ROOM)
+            {
+                distances[image->links[i]] = distances[room] + 1;
+                queue[tail++] = image->links[i];
+            }
+        }
     }
-    while(roomB->numConnections >= 6 || indexA == indexB || ConnectionAlreadyExists(roomA, roomB) == true);
 
-    // Connect the rooms to each other.
-    strcpy(roomA->connections[roomA->numConnections], roomB->name);
-    roomA->numConnections++;
+    uint32_t distance = distances[image->endRoom];
+    free(distances);
+    free(queue);
+    return distance;
+}
 
-    strcpy(roomB->connections[roomB->numConnections], roomA->name);
-    roomB->numConnections++;
+// Empties a distribution of walk lengths.
+void InitWalkStats(struct WalkStats* stats)
+{
+    memset(stats, 0, sizeof(struct WalkStats));
+    stats->min = UINT32_MAX;
 }
 
-// Returns true if a connection from room A to room B already exists, false otherwise..
-bool ConnectionAlreadyExists(struct Room* roomA, struct Room* roomB)
+// Adds a walk to a distribution of walk lengths.
+void AddWalk(struct WalkStats* stats, uint32_t steps, bool capped)
+{
+    stats->numWalks++;
+    stats->numCapped += capped;
+    stats->sum += steps;
+    stats->sumSquares += (double) steps * steps;
+    stats->min = steps < stats->min ? steps : stats->min;
+    stats->max = steps > stats->max ? steps : stats->max;
+    stats->buckets[GetWalkBucket(steps)]++;
+}
+
+// Adds one distribution of walk lengths to another.
+void MergeWalkStats(struct WalkStats* into, struct WalkStats* from)
 {
-    // Get the number of outbound connections for room A.
-    int numConnections = roomA->numConnections;
-    
     int i;
-    for (i = 0; i < numConnections; i++)
+    into->numWalks += from->numWalks;
+    into->numCapped += from->numCapped;
+    into->sum += from->sum;
+    into->sumSquares += from->sumSquares;
+    into->min = from->min < into->min ? from->min : into->min;
+    into->max = from->max > into->max ? from->max : into->max;
+    for (i = 0; i < WALK_BUCKETS; i++)
     {
-        if ((strcmp(roomA->connections[i], roomB->name)) == 0)
-            return true;
+        into->buckets[i] += from->buckets[i];
     }
-    return false;
+}
+
+/* Returns the histogram bucket of a walk length. Lengths below 16 have a bucket each, and every power of two above
+   is split into 16 buckets, so a bucket is never wider than 1/16 of the lengths in it. */
+int GetWalkBucket(uint32_t steps)
+{
+    if (steps < 16)
+    {
+        return steps;
+    }
+    int exponent = 31 - __builtin_clz(steps);
+    return 16 + (exponent - 4) * 16 + ((steps >> (exponent - 4)) & 15);
+}
+
+// Returns the walk length below which the given fraction of the walks fall, to within the width of its bucket.
+uint32_t GetPercentile(struct WalkStats* stats, double fraction)
+{
+    uint64_t rank = (uint64_t) (fraction * stats->numWalks + 0.5);
+    uint64_t seen = 0;
+    int i;
+
+    for (i = 0; i < WALK_BUCKETS - 1; i++)
+    {
+        if ((seen += stats->buckets[i]) >= rank && seen > 0)
+        {
+            break;
+        }
+    }
+
+    // Report the smallest length of the bucket, kept within the lengths actually seen.
+    uint32_t steps = i < 16 ? (uint32_t) i : (uint32_t) (16 + (i - 16) % 16) << ((i - 16) / 16);
+    steps = steps < stats->min ? stats->min : steps;
+    return steps > stats->max ? stats->max : steps;
+}
+
+// Prints the distribution of the walk lengths of a player through a world (or "all" of them).
+void PrintWalkStats(char* world, int player, struct WalkStats* stats, char* shortest)
+{
+    double mean = (double) stats->sum / stats->numWalks;
+    double variance = stats->sumSquares / stats->numWalks - mean * mean;
+
+    printf("%s\t%s\t%lu\t%.1f\t%.1f\t%u\t%u\t%u\t%u\t%u\t%lu\t%s\n", world, players[player],
+           (unsigned long) stats->numWalks, mean, sqrt(variance > 0 ? variance : 0), stats->min,
+           GetPercentile(stats, 0.5), GetPercentile(stats, 0.9), GetPercentile(stats, 0.99), stats->max,
+           (unsigned long) stats->numCapped, shortest);
+    fflush(stdout);
+}
+
+/* Keeps the pool directory of the output directory filled with poolSize validated worlds for games to claim, until
+   SIGINT or SIGTERM. Each world is generated, checked, written into a staging directory and renamed into the pool
+   as rooms.PID.N, so a game only ever sees complete worlds; a game claims one by renaming it (see adventure.c). The
+   generator sleeps on inotify while the pool is full, waking up as soon as a world is claimed, and at least every
+   POOL_RESCAN_MS to clean up after games and generators that died. Returns 0. */
+int RunPool(struct Options* options)
+{
+    char poolDir[PATH_BUFFER];
+    char dirName[PATH_BUFFER];
+    int pid = getpid();
+    int index = 0;
+
+    // The pool's worlds are named like a batch in the pool directory.
+    struct Options poolOptions = *options;
+    snprintf(poolDir, sizeof(poolDir), "%s/%s", options->outputDir, POOL_DIRNAME);
+    poolOptions.outputDir = poolDir;
+    poolOptions.worldsPerDir = 0;
+    MakeDir(options->outputDir);
+    MakeDir(poolDir);
+
+    // Watch the pool for worlds leaving it.
+    int watchFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watchFd == -1 || inotify_add_watch(watchFd, poolDir, IN_MOVED_FROM | IN_DELETE) == -1)
+    {
+        printf("ERROR: Failed to watch directory \"%s\"\n", poolDir);
+        perror("In RunPool() with inotify");
+        exit(1);
+    }
+
+    /* Stop cleanly on SIGINT and SIGTERM, between two worlds. The handler is installed without SA_RESTART, so that a
+       signal interrupts the wait for a world to be claimed instead of waiting out the rescan. */
+    struct sigaction stopAction;
+    memset(&stopAction, 0, sizeof(stopAction));
+    stopAction.sa_handler = HandleStopSignal;
+    sigemptyset(&stopAction.sa_mask);
+    sigaction(SIGINT, &stopAction, NULL);
+    sigaction(SIGTERM, &stopAction, NULL);
+
+    struct Rng rng;
+    SeedRng(&rng, options->hasSeed == true ? options->seed : (uint64_t) time(0) ^ ((uint64_t) pid << 32));
+    struct World world;
+    InitWorld(&world, options);
+
+    while (stopRequested == 0)
+    {
+        if (ScanPool(poolDir) >= options->poolSize)
+        {
+            // Wait for a world to be claimed, then drain the events, which only say that something changed.
+            struct pollfd pollFd = {watchFd, POLLIN, 0};
+            char events[4096];
+            if (poll(&pollFd, 1, POOL_RESCAN_MS) > 0)
+            {
+                while (read(watchFd, events, sizeof(events)) > 0)
+                {
+                }
+            }
+            continue;
+        }
+
+        // Give every world of the pool its own random number stream, as in a batch.
+        struct Rng stream = rng;
+        JumpRng(&rng);
+        world.rng = &stream;
+        GetWorldDirName(&poolOptions, pid, index++, dirName);
+        GenerateWorld(&world, &poolOptions, dirName);
+    }
+
+    close(watchFd);
+    FreeWorld(&world);
+    return 0;
+}
+
+/* Returns the number of worlds ready in the pool. Worlds claimed by games that have exited, and worlds left staged by
+   generators that were killed, are removed along the way. */
+int ScanPool(char* poolDir)
+{
+    DIR* dir;
+    struct dirent* dirEntry;
+    char path[PATH_BUFFER];
+    int numReady = 0;
+    int pid;
+
+    if ((dir = opendir(poolDir)) == NULL)
+    {
+        printf("ERROR: Failed to open directory \"%s\"\n", poolDir);
+        perror("In ScanPool() with opendir()");
+        exit(1);
+    }
+    while ((dirEntry = readdir(dir)) != NULL)
+    {
+        if (strncmp(dirEntry->d_name, "rooms.", 6) == 0)
+        {
+            numReady++;
+        }
+        else if ((sscanf(dirEntry->d_name, CLAIMED_PREFIX "%d", &pid) == 1
+                  || sscanf(dirEntry->d_name, ".rooms.%d.", &pid) == 1)
+                 && kill(pid, 0) != 0 && errno == ESRCH)
+        {
+            snprintf(path, sizeof(path), "%s/%s", poolDir, dirEntry->d_name);
+            RemoveWorldDir(path);
+        }
+    }
+    closedir(dir);
+
+    return numReady;
+}
+
+// Requests the pool generator to stop once the world it is writing is published.
+void HandleStopSignal(int signalNumber)
+{
+    (void) signalNumber;
+    stopRequested = 1;
+}
+
+/* Checks a generated world against the rules of the room files: connection bounds, no self or duplicate links, a
+   matching connection coming back for every connection, one START_ROOM and one END_ROOM, and a path between them.
+   Returns false with the first problem found. */
+bool ValidateWorld(struct World* world, char problem[])
+{
+    int n = world->numRooms;
+    int numStarts = 0, numEnds = 0, startIndex = 0, endIndex = 0;
+    int i, j;
+
+    for (i = 0; i < n; i++)
+    {
+        struct Room* room = &world->rooms[i];
+        int* connections = &world->connections[i * world->maxConnections];
+        const char* name = GetArenaName(world->names, room->name);
+
+        numStarts += room->type == START_ROOM;
+        numEnds += room->type == END_ROOM;
+        startIndex = room->type == START_ROOM ? i : startIndex;
+        endIndex = room->type == END_ROOM ? i : endIndex;
+        if (room->numConnections < world->minConnections || room->numConnections > world->maxConnections)
+        {
+            snprintf(problem, STR_BUFFER, "room %s has %d connections", name, room->numConnections);
+            return false;
+        }
+        for (j = 0; j < room->numConnections; j++)
+        {
+            int k = 0;
+            while (connections[k] != connections[j])
+            {
+                k++;
+            }
+            if (connections[j] == i || k < j)
+            {
+                snprintf(problem, STR_BUFFER, "room %s connects to itself or twice to a room", name);
+                return false;
+            }
+            if (ConnectionAlreadyExists(world, connections[j], i) == false)
+            {
+                snprintf(problem, STR_BUFFER, "room %s has a connection that does not connect back", name);
+                return false;
+            }
+        }
+    }
+    if (numStarts != 1 || numEnds != 1)
+    {
+        snprintf(problem, STR_BUFFER, "%d START_ROOMs and %d END_ROOMs", numStarts, numEnds);
+        return false;
+    }
+
+    // Search from the START_ROOM until the END_ROOM is found.
+    bool* seen = SafeMalloc(sizeof(bool) * n);
+    int* queue = SafeMalloc(sizeof(int) * n);
+    int head = 0, tail = 0;
+    memset(seen, 0, sizeof(bool) * n);
+    seen[startIndex] = true;
+    queue[tail++] = startIndex;
+    while (head < tail && seen[endIndex] == false)
+    {
+        int room = queue[head++];
+        for (j = 0; j < world->rooms[room].numConnections; j++)
+        {
+            int next = world->connections[room * world->maxConnections + j];
+            if (seen[next] == false)
+            {
+                seen[next] = true;
+                queue[tail++] = next;
+            }
+        }
+    }
+    bool reachable = seen[endIndex];
+    free(seen);
+    free(queue);
+    if (reachable == false)
+    {
+        snprintf(problem, STR_BUFFER, "the END_ROOM cannot be reached from the START_ROOM");
+        return false;
+    }
+
+    return true;
+}
+
+/* Creates the rooms of a world and all the connections in its graph, then writes it to a new directory. The world is
+   written into a hidden staging directory next to it, which is renamed into place once every file is written, so the
+   adventure program (which only opens rooms.* directories) never sees a half-written world. With group commit, the
+   world is left staged for CommitBatch(). Returns false if the world is going into the pool but fails validation. */
+bool GenerateWorld(struct World* world, struct Options* options, char* dirName)
+{
+    char stagingName[PATH_BUFFER];
+
+    // Initialize the rooms
+    InitRooms(world);
+
+    // Create all connections in graph.
+    BuildGraph(world);
+
+    // Check a world going into the pool before it is written, as games take it from there without looking.
+    char problem[STR_BUFFER];
+    if (options->poolSize > 0 && ValidateWorld(world, problem) == false)
+    {
+        printf("WARNING: Discarded a world that failed validation: %s\n", problem);
+        fflush(stdout);
+        return false;
+    }
+
+    // Create the staging directory, removing any left behind by an earlier run that was interrupted.
+    GetStagingDirName(dirName, stagingName);
+    RemoveWorldDir(stagingName);
+    if (mkdir(stagingName, 0755) != 0)
+    {
+        printf("ERROR: Failed to create directory \"%s\"\n", stagingName);
+        perror("In GenerateWorld() with mkdir()");
+        exit(1);
+    }
+
+    // Write the room files and/or the binary world file.
+    int i;
+    world->syncFiles = options->durability == WORLD_SYNC;
+    if (options->format & TEXT_FORMAT)
+    {
+        for (i = 0; i < world->numRooms; i++)
+        {
+            MakeRoomFile(world, i, stagingName);
+        }
+        MakeManifestFile(world, stagingName);
+    }
+    if (options->format & BINARY_FORMAT)
+    {
+        MakeWorldFile(world, stagingName);
+    }
+
+    // Move the complete world into place.
+    if (options->durability != BATCH_SYNC)
+    {
+        if (options->durability == WORLD_SYNC)
+        {
+            SyncDir(stagingName);
+        }
+        PublishWorld(stagingName, dirName, options->durability == WORLD_SYNC);
+    }
+    return true;
+}
+
+// Runs in each thread of a batch, generating worlds until every world number has been taken.
+void* GenerateWorlds(void* arg)
+{
+    struct Batch* batch = arg;
+    struct Options* options = batch->options;
+    char dirName[PATH_BUFFER];
+    int index;
+
+    // Each thread reuses one world for all the worlds it generates.
+    struct World world;
+    InitWorld(&world, options);
+
+    while ((index = __sync_fetch_and_add(&batch->nextWorld, 1)) < options->numWorlds)
+    {
+        // Put the world in its group's subdirectory, if the batch is grouped.
+        if (options->worldsPerDir > 0)
+        {
+            snprintf(dirName, sizeof(dirName), "%s/%d", options->outputDir, index / options->worldsPerDir);
+            MakeDir(dirName);
+        }
+        GetWorldDirName(options, batch->pid, index, dirName);
+
+        // Give every world its own random number stream.
+        world.rng = &batch->streams[index];
+        GenerateWorld(&world, options, dirName);
+    }
+
+    FreeWorld(&world);
+    return NULL;
+}
+
+/* Gets the path of a world: rooms.PID in the output directory for a single world (index -1), or rooms.PID.N for world
+   N of a batch, inside its group's subdirectory if the batch is grouped. */
+void GetWorldDirName(struct Options* options, int pid, int index, char* dirName)
+{
+    memset(dirName, '\0', PATH_BUFFER);
+    if (index < 0)
+    {
+        snprintf(dirName, PATH_BUFFER, "%s/rooms.%d", options->outputDir, pid);
+    }
+    else if (options->worldsPerDir > 0)
+    {
+        snprintf(dirName, PATH_BUFFER, "%s/%d/rooms.%d.%d", options->outputDir, index / options->worldsPerDir, pid,
+                 index);
+    }
+    else
+    {
+        snprintf(dirName, PATH_BUFFER, "%s/rooms.%d.%d", options->outputDir, pid, index);
+    }
+}
+
+// Gets the path of the staging directory of a world: the same name with a leading ".", in the same directory.
+void GetStagingDirName(char* dirName, char* stagingName)
+{
+    char* baseName = strrchr(dirName, '/');
+    size_t dirLength = baseName != NULL ? (size_t) (baseName + 1 - dirName) : 0;
+    size_t length = strlen(dirName);
+
+    if (length + 2 > PATH_BUFFER)
+    {
+        printf("ERROR: The path \"%s\" is too long\n", dirName);
+        exit(1);
+    }
+    memcpy(stagingName, dirName, dirLength);
+    stagingName[dirLength] = '.';
+    memcpy(stagingName + dirLength + 1, dirName + dirLength, length - dirLength + 1);
+}
+
+// Renames a staged world into place, and flushes the rename to disk if asked to.
+void PublishWorld(char* stagingName, char* dirName, bool sync)
+{
+    if (rename(stagingName, dirName) != 0)
+    {
+        printf("ERROR: Failed to move \"%s\" to \"%s\"\n", stagingName, dirName);
+        perror("In PublishWorld() with rename()");
+        exit(1);
+    }
+    if (sync == true)
+    {
+        char parentName[PATH_BUFFER];
+        char* baseName = strrchr(dirName, '/');
+        snprintf(parentName, sizeof(parentName), "%.*s", baseName != NULL ? (int) (baseName - dirName) : 1,
+                 baseName != NULL ? dirName : ".");
+        SyncDir(parentName);
+    }
+}
+
+/* Publishes every staged world of the run with group commit: one syncfs() makes all their files durable at once,
+   then the worlds are renamed into place and a second syncfs() makes the renames durable. This costs two flushes
+   however many worlds there are, instead of one per file. */
+void CommitBatch(struct Options* options, int pid)
+{
+    char dirName[PATH_BUFFER];
+    char stagingName[PATH_BUFFER];
+    int i;
+
+    SyncFileSystem(options->outputDir);
+    for (i = options->numWorlds == 0 ? -1 : 0; i < options->numWorlds; i++)
+    {
+        GetWorldDirName(options, pid, i, dirName);
+        GetStagingDirName(dirName, stagingName);
+        PublishWorld(stagingName, dirName, false);
+    }
+    SyncFileSystem(options->outputDir);
+}
+
+// Writes a whole file with a single write() (repeated only if the kernel takes less), flushing it to disk if asked to.
+void WriteWholeFile(char* filename, const char* data, size_t size, bool sync)
+{
+    int fd;
+    size_t written = 0;
+
+    if ((fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1)
+    {
+        printf("ERROR: Failed to open filename \"%s\"\n", filename);
+        perror("In WriteWholeFile()");
+        exit(1);
+    }
+    while (written < size)
+    {
+        ssize_t result = write(fd, data + written, size - written);
+        if (result < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (result <= 0)
+        {
+            printf("ERROR: Failed to write filename \"%s\"\n", filename);
+            perror("In WriteWholeFile() with write()");
+            exit(1);
+        }
+        written += result;
+    }
+    if ((sync == true && fsync(fd) != 0) || close(fd) != 0)
+    {
+        printf("ERROR: Failed to write filename \"%s\"\n", filename);
+        perror("In WriteWholeFile()");
+        exit(1);
+    }
+}
+
+// Flushes every file and directory of the file system holding a path to disk.
+void SyncFileSystem(char* path)
+{
+    int fd;
+    if ((fd = open(path, O_RDONLY | O_DIRECTORY)) == -1 || syncfs(fd) != 0)
+    {
+        printf("ERROR: Failed to flush the file system of \"%s\"\n", path);
+        perror("In SyncFileSystem()");
+        exit(1);
+    }
+    close(fd);
+}
+
+// Creates a directory unless it already exists.
+void MakeDir(char* dirName)
+{
+    if (mkdir(dirName, 0755) != 0 && errno != EEXIST)
+    {
+        printf("ERROR: Failed to create directory \"%s\"\n", dirName);
+        perror("In MakeDir() with mkdir()");
+        exit(1);
+    }
+}
+
+// Atomically points the latest link of the output directory at the given world, flushing the link to disk if asked to.
+void PublishLatest(char* outputDir, char* target, bool sync)
+{
+    char linkName[PATH_BUFFER];
+    char tempName[PATH_BUFFER];
+    snprintf(linkName, sizeof(linkName), "%s/%s", outputDir, LATEST_LINK);
+    snprintf(tempName, sizeof(tempName), "%s/%s.%d", outputDir, LATEST_LINK, (int) getpid());
+
+    // Create the new link under a temporary name, then rename it over the old one.
+    unlink(tempName);
+    if (symlink(target, tempName) != 0 || rename(tempName, linkName) != 0)
+    {
+        printf("ERROR: Failed to point \"%s\" at \"%s\"\n", linkName, target);
+        perror("In PublishLatest()");
+        unlink(tempName);
+        exit(1);
+    }
+    if (sync == true)
+    {
+        SyncDir(outputDir);
+    }
+}
+
+// Removes all but the newest keepWorlds rooms.* directories of the output directory.
+void PruneWorlds(char* outputDir, int keepWorlds)
+{
+    DIR* dir;
+    struct dirent* dirEntry;
+    struct stat dirStat;
+    char path[PATH_BUFFER];
+    char latest[PATH_BUFFER];
+
+    // Never remove the world the latest link points to.
+    memset(latest, '\0', sizeof(latest));
+    snprintf(path, sizeof(path), "%s/%s", outputDir, LATEST_LINK);
+    if (readlink(path, latest, sizeof(latest) - 1) < 0)
+    {
+        latest[0] = '\0';
+    }
+
+    if ((dir = opendir(outputDir)) == NULL)
+    {
+        printf("ERROR: Failed to open directory \"%s\"\n", outputDir);
+        perror("In PruneWorlds() with opendir()");
+        exit(1);
+    }
+
+    // Collect the rooms directories, skipping links and entries that vanish while the directory is read.
+    int numDirs = 0;
+    int capacity = 64;
+    struct WorldDir* dirs = SafeMalloc(sizeof(struct WorldDir) * capacity);
+    while ((dirEntry = readdir(dir)) != NULL)
+    {
+        if (strncmp(dirEntry->d_name, "rooms.", 6) != 0 || strlen(dirEntry->d_name) >= STR_BUFFER
+            || strcmp(dirEntry->d_name, latest) == 0)
+        {
+            continue;
+        }
+        snprintf(path, sizeof(path), "%s/%s", outputDir, dirEntry->d_name);
+        if (lstat(path, &dirStat) != 0 || !S_ISDIR(dirStat.st_mode))
+        {
+            continue;
+        }
+
+        if (numDirs == capacity)
+        {
+            capacity *= 2;
+            struct WorldDir* grown = SafeMalloc(sizeof(struct WorldDir) * capacity);
+            memcpy(grown, dirs, sizeof(struct WorldDir) * numDirs);
+            free(dirs);
+            dirs = grown;
+        }
+        strcpy(dirs[numDirs].name, dirEntry->d_name);
+        dirs[numDirs].modified = dirStat.st_mtim;
+        dirs[numDirs].pid = -1;
+        dirs[numDirs].index = -1;
+        sscanf(dirEntry->d_name, "rooms.%d.%d", &dirs[numDirs].pid, &dirs[numDirs].index);
+        numDirs++;
+    }
+    closedir(dir);
+
+    /* The threads of a batch finish its worlds in any order, so the worlds of one process are dated by the newest of
+       them and ordered by their index in the batch, rather than each by its own modification time. */
+    int i, j;
+    qsort(dirs, numDirs, sizeof(struct WorldDir), CompareWorldBatches);
+    for (i = 0; i < numDirs; i = j)
+    {
+        for (j = i; j < numDirs && (j == i || (dirs[j].pid == dirs[i].pid && dirs[i].pid >= 0)); j++)
+        {
+            dirs[j].batchModified = dirs[i].modified;
+        }
+    }
+
+    // Sort newest first, and remove everything past the limit (a latest world in the output directory itself counts
+    // as one of the kept ones).
+    qsort(dirs, numDirs, sizeof(struct WorldDir), CompareWorldDirs);
+    for (i = (latest[0] != '\0' && strchr(latest, '/') == NULL ? keepWorlds - 1 : keepWorlds); i < numDirs; i++)
+    {
+        snprintf(path, sizeof(path), "%s/%s", outputDir, dirs[i].name);
+        RemoveWorldDir(path);
+    }
+    free(dirs);
+}
+
+/* Orders rooms directories from the newest to the oldest, for qsort(): by the newest world of their process, then
+   the last world of a batch first. */
+int CompareWorldDirs(const void* a, const void* b)
+{
+    const struct WorldDir* dirA = a;
+    const struct WorldDir* dirB = b;
+    if (dirA->batchModified.tv_sec != dirB->batchModified.tv_sec)
+    {
+        return dirA->batchModified.tv_sec < dirB->batchModified.tv_sec ? 1 : -1;
+    }
+    if (dirA->batchModified.tv_nsec != dirB->batchModified.tv_nsec)
+    {
+        return dirA->batchModified.tv_nsec < dirB->batchModified.tv_nsec ? 1 : -1;
+    }
+    if (dirA->pid != dirB->pid)
+    {
+        return dirA->pid < dirB->pid ? 1 : -1;
+    }
+    if (dirA->index != dirB->index)
+    {
+        return dirA->index < dirB->index ? 1 : -1;
+    }
+    return strcmp(dirB->name, dirA->name);
+}
+
+// Orders rooms directories by process id, and the newest first within a process, for qsort().
+int CompareWorldBatches(const void* a, const void* b)
+{
+    const struct WorldDir* dirA = a;
+    const struct WorldDir* dirB = b;
+    if (dirA->pid != dirB->pid)
+    {
+        return dirA->pid < dirB->pid ? -1 : 1;
+    }
+    if (dirA->modified.tv_sec != dirB->modified.tv_sec)
+    {
+        return dirA->modified.tv_sec < dirB->modified.tv_sec ? 1 : -1;
+    }
+    if (dirA->modified.tv_nsec != dirB->modified.tv_nsec)
+    {
+        return dirA->modified.tv_nsec < dirB->modified.tv_nsec ? 1 : -1;
+    }
+    return strcmp(dirB->name, dirA->name);
+}
+
+// Removes a rooms directory and the files inside it. A world that cannot be removed is reported and left alone.
+void RemoveWorldDir(char* dirName)
+{
+    DIR* dir;
+    struct dirent* dirEntry;
+    char path[PATH_BUFFER];
+
+    if ((dir = opendir(dirName)) == NULL)
+    {
+        return;
+    }
+    while ((dirEntry = readdir(dir)) != NULL)
+    {
+        if (strcmp(dirEntry->d_name, ".") != 0 && strcmp(dirEntry->d_name, "..") != 0)
+        {
+            snprintf(path, sizeof(path), "%s/%s", dirName, dirEntry->d_name);
+            unlink(path);
+        }
+    }
+    closedir(dir);
+
+    if (rmdir(dirName) != 0)
+    {
+        printf("WARNING: Could not remove old world \"%s\"\n", dirName);
+    }
+}
+
+// Allocates the rooms and connection slots of a world.
+void InitWorld(struct World* world, struct Options* options)
+{
+    world->numRooms = options->numRooms;
+    world->minConnections = options->minConnections;
+    world->maxConnections = options->maxConnections;
+    world->rooms = SafeMalloc(sizeof(struct Room) * world->numRooms);
+    world->connections = SafeMalloc(sizeof(int) * world->numRooms * world->maxConnections);
+    world->fileText = SafeMalloc(ROOM_LINE_BUFFER * (world->maxConnections + 2));
+    world->syncFiles = false;
+
+    // Every name takes its length, a length byte and a null character, and is at most as long as the longest name.
+    size_t longestName = 2 * GetNumSyllables(world->numRooms);
+    int i;
+    for (i = 0; i < NUM_OF_NAMES; i++)
+    {
+        longestName = strlen(names[i]) > longestName ? strlen(names[i]) : longestName;
+    }
+    world->names = SafeMalloc(sizeof(struct NameArena));
+    world->names->capacity = (longestName + 2) * (size_t) world->numRooms;
+    world->names->data = SafeMalloc(world->names->capacity);
+    world->names->size = 0;
+}
+
+// Frees the memory held by a world.
+void FreeWorld(struct World* world)
+{
+    free(world->rooms);
+    free(world->connections);
+    free(world->fileText);
+    free(world->names->data);
+    free(world->names);
+    world->rooms = NULL;
+    world->connections = NULL;
+    world->fileText = NULL;
+    world->names = NULL;
+}
+
+// Initializes the array of rooms.
+void InitRooms(struct World* world)
+{
+    // Indexes for shuffling in order to randomly select room names.
+    int indexes[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+
+    // Shuffle array of indexes.
+    Shuffle(indexes, NUM_OF_NAMES, world->rng);
+
+    /* Assign names randomly using the shuffled indexes (or generate them if there are more rooms than names),
+       initialize numConnections, and assign room types */
+    int i;
+    world->names->size = 0;
+    for (i = 0; i < world->numRooms; i++)
+    {
+        if (world->numRooms <= NUM_OF_NAMES)
+        {
+            world->rooms[i].name = AddName(world->names, names[indexes[i]], strlen(names[indexes[i]]));
+        }
+        world->rooms[i].numConnections = 0;
+        world->rooms[i].type = MID_ROOM;
+    }
+    if (world->numRooms > NUM_OF_NAMES)
+    {
+        GenerateNames(world);
+    }
+
+    // Re-assign the room types for two randomly chosen rooms.
+    int startIndex = RandomInt(world->rng, world->numRooms);
+    int endIndex = RandomInt(world->rng, world->numRooms - 1);
+    if (endIndex >= startIndex)
+    {
+        endIndex++;
+    }
+    world->rooms[startIndex].type = START_ROOM;
+    world->rooms[endIndex].type = END_ROOM;
+}
+
+/* Gives every room a generated name: a capitalized word of syllables, each a consonant and a vowel (e.g. Tavoki),
+   with as few syllables as give every room a name of its own. Name number PermuteName(i) goes to room i, and as
+   PermuteName() is a bijection, the names are unique without ever being compared, and are spread over the possible
+   names rather than counting up. The keys of the permutation come from the world's random number generator without
+   drawing from it, so the names depend only on the seed, and the rest of the world is the same as without them. */
+void GenerateNames(struct World* world)
+{
+    int numSyllables = GetNumSyllables(world->numRooms);
+    uint64_t numNames = 1;
+    int i, j;
+    for (i = 0; i < numSyllables; i++)
+    {
+        numNames *= NUM_OF_SYLLABLES;
+    }
+
+    // Permute over the smallest square power of two that holds every name, so both halves have the same bits.
+    int halfBits = 1;
+    while (((uint64_t) 1 << (2 * halfBits)) < numNames)
+    {
+        halfBits++;
+    }
+    uint64_t keys[NAME_ROUNDS];
+    for (i = 0; i < NAME_ROUNDS; i++)
+    {
+        keys[i] = MixBits(world->rng->state[i % 4] + (uint64_t) i);
+    }
+
+    char name[MAX_NAME_LENGTH];
+    int numVowels = strlen(SYLLABLE_VOWELS);
+    for (i = 0; i < world->numRooms; i++)
+    {
+        // Spell the name number out one syllable at a time.
+        uint64_t number = PermuteName(i, numNames, halfBits, keys);
+        for (j = 0; j < numSyllables; j++)
+        {
+            int syllable = number % NUM_OF_SYLLABLES;
+            number /= NUM_OF_SYLLABLES;
+            name[2*j] = SYLLABLE_CONSONANTS[syllable / numVowels];
+            name[2*j + 1] = SYLLABLE_VOWELS[syllable % numVowels];
+        }
+        name[0] += 'A' - 'a';
+        world->rooms[i].name = AddName(world->names, name, 2 * numSyllables);
+    }
+}
+
+/* Returns the name number of a room: a keyed permutation of the numbers below numNames. A balanced Feistel network
+   permutes the numbers of 2 * halfBits bits, and numbers at or above numNames are permuted again until they fall
+   below it (cycle walking), which keeps it a permutation of the smaller range. */
+uint64_t PermuteName(uint64_t index, uint64_t numNames, int halfBits, const uint64_t keys[])
+{
+    uint64_t halfMask = ((uint64_t) 1 << halfBits) - 1;
+    do
+    {
+        uint64_t left = index >> halfBits;
+        uint64_t right = index & halfMask;
+        int round;
+        for (round = 0; round < NAME_ROUNDS; round++)
+        {
+            uint64_t next = left ^ (MixBits(right ^ keys[round]) & halfMask);
+            left = right;
+            right = next;
+        }
+        index = (left << halfBits) | right;
+    } while (index >= numNames);
+    return index;
+}
+
+// Returns the number of syllables of the generated names of a world, enough to give every room its own name.
+int GetNumSyllables(int numRooms)
+{
+    int numSyllables = MIN_SYLLABLES;
+    uint64_t numNames = (uint64_t) NUM_OF_SYLLABLES * NUM_OF_SYLLABLES;
+    while (numNames < (uint64_t) numRooms)
+    {
+        numNames *= NUM_OF_SYLLABLES;
+        numSyllables++;
+    }
+    return numSyllables;
+}
+
+// Adds a name to the end of a name arena, which has space for it, and returns its id.
+uint32_t AddName(struct NameArena* arena, const char* name, size_t length)
+{
+    uint32_t id = arena->size;
+    arena->data[arena->size] = (char) length;
+    memcpy(arena->data + arena->size + 1, name, length);
+    arena->data[arena->size + 1 + length] = '\0';
+    arena->size += length + 2;
+    return id;
+}
+
+// Returns the null-terminated name with the given id.
+const char* GetArenaName(struct NameArena* arena, uint32_t id)
+{
+    return arena->data + id + 1;
+}
+
+// Returns the length of the name with the given id.
+size_t GetArenaNameLength(struct NameArena* arena, uint32_t id)
+{
+    return (unsigned char) arena->data[id];
+}
+
+// Scrambles the bits of a number with the splitmix64 finalizer.
+uint64_t MixBits(uint64_t z)
+{
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// Seeds a random number generator, expanding the seed into the full state with splitmix64.
+void SeedRng(struct Rng* rng, uint64_t seed)
+{
+    int i;
+    for (i = 0; i < 4; i++)
+    {
+        uint64_t z = (seed += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        rng->state[i] = z ^ (z >> 31);
+    }
+}
+
+// Returns the next 64 random bits from a xoshiro256** generator.
+uint64_t NextRandom(struct Rng* rng)
+{
+    uint64_t* s = rng->state;
+    uint64_t x = s[1] * 5;
+    uint64_t result = ((x << 7) | (x >> 57)) * 9;
+    uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = (s[3] << 45) | (s[3] >> 19);
+
+    return result;
+}
+
+// Advances a generator by 2^128 numbers, giving a stream that never overlaps the numbers the original state yields.
+void JumpRng(struct Rng* rng)
+{
+    static const uint64_t jump[] = { 0x180EC6D33CFD0ABAULL, 0xD5A61266F0C9392CULL,
+                                     0xA9582618E03FC9AAULL, 0x39ABDC4529B1661CULL };
+    uint64_t s[4] = {0, 0, 0, 0};
+    int i, b, k;
+
+    for (i = 0; i < 4; i++)
+    {
+        for (b = 0; b < 64; b++)
+        {
+            if (jump[i] & ((uint64_t) 1 << b))
+            {
+                for (k = 0; k < 4; k++)
+                {
+                    s[k] ^= rng->state[k];
+                }
+            }
+            NextRandom(rng);
+        }
+    }
+    memcpy(rng->state, s, sizeof(s));
+}
+
+/* Returns a random integer from 0 to n-1 without modulo bias, using Lemire's multiply-and-reject method: the high
+   half of a 32x32 bit product is the result, and the rare products that would favour some results are redrawn. */
+int RandomInt(struct Rng* rng, int n)
+{
+    uint32_t range = n;
+    uint64_t product = (NextRandom(rng) >> 32) * range;
+    uint32_t low = (uint32_t) product;
+
+    if (low < range)
+    {
+        uint32_t threshold = -range % range;
+        while (low < threshold)
+        {
+            product = (NextRandom(rng) >> 32) * range;
+            low = (uint32_t) product;
+        }
+    }
+    return product >> 32;
+}
+
+// Shuffles an array of integers using the Fisher-Yates shuffle algorithm.
+void Shuffle(int arr[], int n, struct Rng* rng)
+{
+   int i, j, tmp;   // Index variables.
+
+   for (i = n-1 ; i > 0; i--)
+   {
+        // Get a random index from 0 to i (inclusive, so every permutation is equally likely).
+        j = RandomInt(rng, i + 1);
+
+        // Swap the current index with the random index.
+        tmp = arr[i];
+        arr[i] = arr[j];
+        arr[j] = tmp;
+   }
+}
+
+// Creates all connections in the graph, so that every room ends up with minConnections to maxConnections links.
+void BuildGraph(struct World* world)
+{
+    int n = world->numRooms;
+    int i, j;
+
+    // Link the rooms in a random ring, giving every room two connections and keeping the world connected.
+    int* order = SafeMalloc(sizeof(int) * n);
+    for (i = 0; i < n; i++)
+    {
+        order[i] = i;
+    }
+    Shuffle(order, n, world->rng);
+    for (i = 0; i < n; i++)
+    {
+        ConnectRooms(world, order[i], order[(i+1) % n]);
+    }
+    free(order);
+
+    // Give every room a random target number of connections and create one slot for each link still missing.
+    int range = world->maxConnections - world->minConnections + 1;
+    int* slots = SafeMalloc(sizeof(int) * n * world->maxConnections);
+    int numSlots = 0;
+    for (i = 0; i < n; i++)
+    {
+        int target = world->minConnections + RandomInt(world->rng, range);
+        for (j = world->rooms[i].numConnections; j < target; j++)
+        {
+            slots[numSlots++] = i;
+        }
+    }
+
+    // Pair the slots up randomly, skipping pairs that would create a self link or a duplicate link.
+    Shuffle(slots, numSlots, world->rng);
+    for (i = 0; i + 1 < numSlots; i += 2)
+    {
+        if (CanConnect(world, slots[i], slots[i+1]) == true)
+        {
+            ConnectRooms(world, slots[i], slots[i+1]);
+        }
+    }
+    free(slots);
+
+    /* Top up any room left with too few connections. Every call to AddRandomConnection() lowers the total number of
+       connections the rooms are short of, so this ends after at most minConnections calls per room. */
+    while (IsGraphFull(world) == false)
+    {
+        for (i = 0; i < n; i++)
+        {
+            while (world->rooms[i].numConnections < world->minConnections)
+            {
+                AddRandomConnection(world, i);
+            }
+        }
+    }
+}
+
+// Creates a room file, formatting it into the world's file text and writing it with a single call.
+void MakeRoomFile(struct World* world, int index, char* dir)
+{
+    struct Room* room = &world->rooms[index];
+    int* connections = &world->connections[index * world->maxConnections];
+    char* text = world->fileText;
+    size_t length = 0;
+
+    // Buffer to hold the filename.
+    char filename[PATH_BUFFER];
+    snprintf(filename, sizeof(filename), "%s/%s_room", dir, GetArenaName(world->names, room->name));
+
+    // Format the room name line, a line for each connection and the room type line.
+    length += FormatRoomLine(text + length, "ROOM NAME", 0, GetArenaName(world->names, room->name),
+                             GetArenaNameLength(world->names, room->name));
+    int i;
+    for (i = 1; i <= room->numConnections; i++)
+    {
+        uint32_t name = world->rooms[connections[i-1]].name;
+        length += FormatRoomLine(text + length, "CONNECTION", i, GetArenaName(world->names, name),
+                                 GetArenaNameLength(world->names, name));
+    }
+    length += FormatRoomLine(text + length, "ROOM TYPE", 0, types[room->type], strlen(types[room->type]));
+
+    WriteWholeFile(filename, text, length, world->syncFiles);
+}
+
+/* Formats a line of a room file, "KEY: value" or "KEY <number>: value" if the number is above 0, without going
+   through printf(). Returns the length of the line, which is at most ROOM_LINE_BUFFER. */
+size_t FormatRoomLine(char* line, const char* key, int number, const char* value, size_t valueLength)
+{
+    char digits[12];
+    size_t length = strlen(key);
+    int numDigits = 0;
+
+    memcpy(line, key, length);
+    if (number > 0)
+    {
+        // Write the digits backwards, then copy them out in order.
+        while (number > 0)
+        {
+            digits[numDigits++] = '0' + number % 10;
+            number /= 10;
+        }
+        line[length++] = ' ';
+        while (numDigits > 0)
+        {
+            line[length++] = digits[--numDigits];
+        }
+    }
+    line[length++] = ':';
+    line[length++] = ' ';
+    memcpy(line + length, value, valueLength);
+    length += valueLength;
+    line[length++] = '\n';
+
+    return length;
+}
+
+/* Creates the manifest file, which names the START_ROOM and the number of rooms so that a game loading rooms on
+   demand can start without reading every room file. */
+void MakeManifestFile(struct World* world, char* dir)
+{
+    // Find the START_ROOM.
+    int i = 0;
+    while (world->rooms[i].type != START_ROOM)
+    {
+        i++;
+    }
+
+    // Buffer to hold the filename.
+    char filename[PATH_BUFFER];
+    snprintf(filename, sizeof(filename), "%s/%s", dir, MANIFEST_FILENAME);
+
+    char text[STR_BUFFER];
+    int length = snprintf(text, sizeof(text), "START ROOM: %s\nROOMS: %d\n",
+                          GetArenaName(world->names, world->rooms[i].name), world->numRooms);
+    WriteWholeFile(filename, text, length, world->syncFiles);
+}
+
+// Returns true if all rooms have at least the minimum number of outbound connections, false otherwise.
+bool IsGraphFull(struct World* world)
+{
+    int i;
+    for (i = 0; i < world->numRooms; i++)
+    {
+        if (world->rooms[i].numConnections < world->minConnections)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Adds a random, valid outbound connection from the given Room, which is short of connections, to another Room. The
+   rooms are short of fewer connections in total afterwards, and the world stays connected. */
+void AddRandomConnection(struct World* world, int indexA)
+{
+    int n = world->numRooms;
+    int tries, i, j, k, indexB, indexC, indexD;
+
+    // Try a few random rooms first, this almost always succeeds unless most rooms are already full.
+    for (tries = 0; tries < MAX_RANDOM_TRIES; tries++)
+    {
+        indexB = RandomInt(world->rng, n);
+        if (CanConnect(world, indexA, indexB) == true)
+        {
+            ConnectRooms(world, indexA, indexB);
+            return;
+        }
+    }
+
+    // Otherwise scan every room once, starting from a random one.
+    int start = RandomInt(world->rng, n);
+    for (i = 0; i < n; i++)
+    {
+        indexB = (start + i) % n;
+        if (CanConnect(world, indexA, indexB) == true)
+        {
+            ConnectRooms(world, indexA, indexB);
+            return;
+        }
+    }
+
+    /* Every room that is not already connected to room A is full, so take over one of their links instead: B-C
+       becomes A-B and C-D, where D is room A itself if it has space for two more connections, or else another room
+       short of connections. There is one, as the connections of all rooms add up to an even number, and it is
+       connected to room A, as every other room is full. B and C keep their number of connections while A and D
+       each gain one, and B and C stay connected to each other through A (and D), so the world stays connected. */
+    for (k = -1; k < world->rooms[indexA].numConnections; k++)
+    {
+        if (k == -1)
+        {
+            indexD = indexA;
+            if (world->rooms[indexA].numConnections + 2 > world->maxConnections)
+            {
+                continue;
+            }
+        }
+        else
+        {
+            indexD = world->connections[indexA * world->maxConnections + k];
+            if (world->rooms[indexD].numConnections >= world->minConnections)
+            {
+                continue;
+            }
+        }
+        for (i = 0; i < n; i++)
+        {
+            indexB = (start + i) % n;
+            if (indexB == indexA || ConnectionAlreadyExists(world, indexA, indexB) == true)
+            {
+                continue;
+            }
+            for (j = 0; j < world->rooms[indexB].numConnections; j++)
+            {
+                indexC = world->connections[indexB * world->maxConnections + j];
+                if (indexC != indexA && indexC != indexD && ConnectionAlreadyExists(world, indexD, indexC) == false)
+                {
+                    DisconnectRooms(world, indexB, indexC);
+                    ConnectRooms(world, indexA, indexB);
+                    ConnectRooms(world, indexD, indexC);
+                    return;
+                }
+            }
+        }
+    }
+
+    // If this point is reached, the connection bounds cannot be satisfied.
+    printf("ERROR: Could not find a valid connection for room %s\n",
+           GetArenaName(world->names, world->rooms[indexA].name));
+    exit(1);
+}
+
+// Returns true if rooms A and B are different, both have space for another link, and are not linked yet.
+bool CanConnect(struct World* world, int indexA, int indexB)
+{
+    return indexA != indexB
+        && world->rooms[indexA].numConnections < world->maxConnections
+        && world->rooms[indexB].numConnections < world->maxConnections
+        && ConnectionAlreadyExists(world, indexA, indexB) == false;
+}
+
+// Connects the rooms to each other.
+void ConnectRooms(struct World* world, int indexA, int indexB)
+{
+    struct Room* roomA = &world->rooms[indexA];
+    struct Room* roomB = &world->rooms[indexB];
+
+    world->connections[indexA * world->maxConnections + roomA->numConnections] = indexB;
+    roomA->numConnections++;
+
+    world->connections[indexB * world->maxConnections + roomB->numConnections] = indexA;
+    roomB->numConnections++;
+}
+
+// Removes the connections between two rooms, moving each room's last connection into the freed slot.
+void DisconnectRooms(struct World* world, int indexA, int indexB)
+{
+    int pass, i;
+    int from = indexA, to = indexB;
+
+    for (pass = 0; pass < 2; pass++)
+    {
+        int* connections = &world->connections[from * world->maxConnections];
+        struct Room* room = &world->rooms[from];
+        for (i = 0; i < room->numConnections; i++)
+        {
+            if (connections[i] == to)
+            {
+                connections[i] = connections[room->numConnections - 1];
+                room->numConnections--;
+                break;
+            }
+        }
+
+        // Then remove the matching connection coming back.
+        from = indexB;
+        to = indexA;
+    }
+}
+
+// Returns true if a connection from room A to room B already exists, false otherwise..
+bool ConnectionAlreadyExists(struct World* world, int indexA, int indexB)
+{
+    // Get the number of outbound connections for room A.
+    int numConnections = world->rooms[indexA].numConnections;
+    int* connections = &world->connections[indexA * world->maxConnections];
+
+    int i;
+    for (i = 0; i < numConnections; i++)
+    {
+        if (connections[i] == indexB)
+            return true;
+    }
+    return false;
+}
+
+// Creates the binary world file, laid out in memory first so that it is written with a single call.
+void MakeWorldFile(struct World* world, char* dir)
+{
+    struct WorldImage image;
+    FillWorldImage(world, &image);
+
+    // Buffer to hold the filename.
+    char filename[PATH_BUFFER];
+    snprintf(filename, sizeof(filename), "%s/%s", dir, WORLD_FILENAME);
+
+    // Write the whole file at once.
+    WriteWholeFile(filename, (char*) image.data, image.size, world->syncFiles);
+
+    free(image.data);
+}
+
+/* Lays a world out as a sealed world image (see world.h) in a newly allocated block, which the caller frees through
+   image->data. */
+void FillWorldImage(struct World* world, struct WorldImage* image)
+{
+    int n = world->numRooms;
+    int i, j;
+
+    // Count the links and the size of the string pool.
+    size_t numLinks = 0;
+    size_t poolSize = 0;
+    for (i = 0; i < n; i++)
+    {
+        numLinks += world->rooms[i].numConnections;
+        poolSize += GetArenaNameLength(world->names, world->rooms[i].name) + 1;
+    }
+
+    // Lay out the sections.
+    size_t size = GetWorldImageSize(n, numLinks, poolSize);
+    unsigned char* data = SafeMalloc(size);
+    memset(data, 0, size);
+    InitWorldImage(image, data, n, numLinks, poolSize);
+
+    // Fill in the CSR connection arrays, the room types, the name offsets and the string pool.
+    uint32_t linkIndex = 0;
+    uint32_t poolIndex = 0;
+    for (i = 0; i < n; i++)
+    {
+        struct Room* room = &world->rooms[i];
+        int* connections = &world->connections[i * world->maxConnections];
+        size_t nameLength = GetArenaNameLength(world->names, room->name);
+
+        image->linkOffsets[i] = linkIndex;
+        for (j = 0; j < room->numConnections; j++)
+        {
+            image->links[linkIndex++] = connections[j];
+        }
+
+        image->types[i] = room->type;
+        image->nameOffsets[i] = poolIndex;
+        memcpy(image->stringPool + poolIndex, GetArenaName(world->names, room->name), nameLength + 1);
+        poolIndex += nameLength + 1;
+
+        if (room->type == START_ROOM)
+            image->startRoom = i;
+        else if (room->type == END_ROOM)
+            image->endRoom = i;
+    }
+    image->linkOffsets[n] = linkIndex;
+    image->nameOffsets[n] = poolIndex;
+
+    // Checksum everything after the header and put the header in place.
+    SealWorldImage(image);
 }
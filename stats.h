@@ -0,0 +1,63 @@
+/*************************************************************************************************************************
+ *
+ * NAME
+ *    stats.h - the live statistics file shared by the game program and the statistics reader
+ * SYNOPSIS
+ *    Declares the layout of a statistics file: the counters a running adventure program keeps in a file mapped into
+ *    memory, which advstats reads from outside the game while it runs.
+ * INSTRUCTIONS
+ *    Include this header in adventure.c and advstats.c, it needs no source file of its own, e.g.:
+ *       gcc -o advstats advstats.c
+ * DESCRIPTION
+ *    A statistics file, named adventure.PID.stats after the game's process id, is a header followed by STATS_BLOCKS
+ *       counter blocks, each starting on a cache line of its own. Every thread of the game claims a block on its
+ *       first count and is the only thread ever writing it, so counting is a plain load, add and store (no lock
+ *       prefix), and no cache line is written by two threads. Block 0 is left for any threads beyond the others,
+ *       which share it with atomic adds. A reader adds up the blocks, so it sees every count made so far.
+ *    The names of the counters are written into the header, so the reader shows whichever counters the game keeps.
+ *       The magic number is written last, so a reader skips a file that is still being set up.
+ * AUTHOR
+ *    Written by Andrew Swaim
+ *
+*************************************************************************************************************************/
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+
+#define STATS_PREFIX "adventure."   // Statistics files are named adventure.PID.stats.
+#define STATS_SUFFIX ".stats"
+#define STATS_MAGIC "ADVSTATS"      // Identifies a statistics file (8 characters, no null character stored).
+#define STATS_VERSION 1             // Bumped whenever the layout of a statistics file changes.
+#define STATS_BLOCKS 64             // Counter blocks of a statistics file, block 0 is shared by any extra threads.
+#define STATS_COUNTERS 16           // Most counters a block holds.
+#define STATS_NAME_LENGTH 24        // Longest counter name, with its null character.
+
+// Header of a statistics file.
+struct StatsHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t numCounters;
+    uint32_t numBlocks;             // Blocks claimed so far, counting any threads sharing block 0.
+    int32_t pid;                    // Process id of the game, to tell whether it is still running.
+    int64_t startTime;              // When the game started, in seconds since the epoch.
+    uint64_t loadWorldNanoseconds;  // Time the world took to find and load, 0 until it is loaded.
+    char counterNames[STATS_COUNTERS][STATS_NAME_LENGTH];
+};
+
+// StatsBlock struct, the counters of one thread, on cache lines of its own.
+struct StatsBlock
+{
+    uint64_t counts[STATS_COUNTERS];
+} __attribute__((aligned(64)));
+
+// StatsFile struct, the whole statistics file.
+struct StatsFile
+{
+    struct StatsHeader header;
+    struct StatsBlock blocks[STATS_BLOCKS];
+};
+
+#endif
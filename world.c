@@ -0,0 +1,248 @@
+/*************************************************************************************************************************
+ *
+ * NAME
+ *    world.c - the world representation shared by the room-building program and the game program
+ * SYNOPSIS
+ *    Lays out, seals and checks world images, see world.h for the layout.
+ * INSTRUCTIONS
+ *    Compile along with buildrooms.c or adventure.c, e.g.:
+ *       gcc -o buildrooms buildrooms.c world.c bench.c -lpthread -lm
+ * DESCRIPTION
+ *    A program building a world allocates GetWorldImageSize() zeroed bytes, points a WorldImage at them with
+ *       InitWorldImage(), fills in the sections and the start and end rooms, and calls SealWorldImage() to write the
+ *       header and checksum. A program reading a world (from a file or memory) calls AttachWorldImage(), which checks
+ *       the header, checksum and contents before pointing a WorldImage at the sections, so a corrupt image is
+ *       rejected instead of being read out of bounds. An image that was already checked, or built by the program
+ *       itself (such as a copy shared between games), is attached with AttachSealedWorldImage(), which skips the checks.
+ *    Also holds the file system helpers both programs share, such as SyncDir().
+ * AUTHOR
+ *    Written by Andrew Swaim
+ *
+*************************************************************************************************************************/
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "world.h"
+
+// Room type strings, in enum Types order.
+char* types[] = {"START_ROOM"
+                , "MID_ROOM"
+                , "END_ROOM"};
+
+/*************************************************************************************************************************
+ * Function Declarations
+*************************************************************************************************************************/
+
+static void LayOutWorldImage(struct WorldHeader* header, uint32_t numRooms, uint32_t numLinks, size_t poolSize);
+static void PointAtSections(struct WorldImage* image, struct WorldHeader* header, unsigned char* data);
+
+/*************************************************************************************************************************
+ * Functions
+*************************************************************************************************************************/
+
+// Returns the size of the image of a world with the given number of rooms, links and string pool size.
+size_t GetWorldImageSize(uint32_t numRooms, uint32_t numLinks, size_t poolSize)
+{
+    struct WorldHeader header;
+    LayOutWorldImage(&header, numRooms, numLinks, poolSize);
+    return header.fileSize;
+}
+
+/* Points a world image at a block of GetWorldImageSize() zeroed bytes, ready for its sections to be filled in. The
+   string pool is already zeroed, so names copied into it are null-terminated. */
+void InitWorldImage(struct WorldImage* image, unsigned char* data, uint32_t numRooms, uint32_t numLinks,
+                    size_t poolSize)
+{
+    struct WorldHeader header;
+    LayOutWorldImage(&header, numRooms, numLinks, poolSize);
+    PointAtSections(image, &header, data);
+    image->startRoom = numRooms;    // Out of range until the builder sets them.
+    image->endRoom = numRooms;
+}
+
+// Writes the header of a filled in world image, checksumming everything after it.
+void SealWorldImage(struct WorldImage* image)
+{
+    struct WorldHeader header;
+    LayOutWorldImage(&header, image->numRooms, image->numLinks, image->stringPoolSize);
+    header.startRoom = image->startRoom;
+    header.endRoom = image->endRoom;
+    header.checksum = Checksum(image->data + header.headerSize, header.fileSize - header.headerSize);
+    memcpy(image->data, &header, sizeof(header));
+}
+
+/* Checks the header, checksum and contents of a world image and points the image at its sections.
+   Returns NULL on success, or a description of the problem if the image is not valid. */
+char* AttachWorldImage(struct WorldImage* image, unsigned char* data, size_t size)
+{
+    struct WorldHeader header;
+    struct WorldHeader expected;
+
+    // Check the header.
+    if (size < sizeof(header))
+    {
+        return "file is too small";
+    }
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, WORLD_MAGIC, sizeof(header.magic)) != 0)
+    {
+        return "bad magic number";
+    }
+    if (header.version != WORLD_VERSION)
+    {
+        return "unsupported version";
+    }
+    if (header.fileSize != size || header.stringPoolSize > size)
+    {
+        return "bad file size";
+    }
+    if (header.numRooms == 0 || header.startRoom >= header.numRooms || header.endRoom >= header.numRooms)
+    {
+        return "bad room count or start/end room";
+    }
+
+    // The sections are laid out by the counts alone, so every offset must be the one computed from them.
+    LayOutWorldImage(&expected, header.numRooms, header.numLinks, header.stringPoolSize);
+    if (header.headerSize != expected.headerSize || header.linkOffsetsOffset != expected.linkOffsetsOffset
+        || header.linksOffset != expected.linksOffset || header.typesOffset != expected.typesOffset
+        || header.nameOffsetsOffset != expected.nameOffsetsOffset
+        || header.stringPoolOffset != expected.stringPoolOffset || header.fileSize != expected.fileSize)
+    {
+        return "section out of bounds";
+    }
+
+    // Check the contents.
+    if (Checksum(data + header.headerSize, size - header.headerSize) != header.checksum)
+    {
+        return "checksum mismatch";
+    }
+    PointAtSections(image, &header, data);
+    image->startRoom = header.startRoom;
+    image->endRoom = header.endRoom;
+
+    if (image->linkOffsets[0] != 0 || image->linkOffsets[image->numRooms] != header.numLinks)
+    {
+        return "bad connection offsets";
+    }
+    if (image->nameOffsets[0] != 0 || image->nameOffsets[image->numRooms] != header.stringPoolSize)
+    {
+        return "bad name offsets";
+    }
+
+    // Check that the rooms only refer to names and rooms inside the image.
+    uint32_t i;
+    for (i = 0; i < header.numRooms; i++)
+    {
+        if (image->types[i] > END_ROOM)
+        {
+            return "bad room type";
+        }
+        if (image->nameOffsets[i+1] < image->nameOffsets[i] + 2 || image->nameOffsets[i+1] > header.stringPoolSize
+            || image->stringPool[image->nameOffsets[i+1] - 1] != '\0')
+        {
+            return "bad name offsets";
+        }
+        if (image->linkOffsets[i] > image->linkOffsets[i+1])
+        {
+            return "bad connection offsets";
+        }
+    }
+    for (i = 0; i < header.numLinks; i++)
+    {
+        if (image->links[i] >= header.numRooms)
+        {
+            return "connection to a room out of range";
+        }
+    }
+
+    return NULL;
+}
+
+/* Points a world image at the sections of an image that was sealed by SealWorldImage() and has not been changed
+   since, without checking it again. Only for images checked by AttachWorldImage() or built by this program. */
+void AttachSealedWorldImage(struct WorldImage* image, unsigned char* data)
+{
+    struct WorldHeader header;
+    memcpy(&header, data, sizeof(header));
+    PointAtSections(image, &header, data);
+    image->startRoom = header.startRoom;
+    image->endRoom = header.endRoom;
+}
+
+// Rounds a size up to the alignment of the sections of a world image.
+size_t AlignSize(size_t size)
+{
+    return (size + WORLD_ALIGN - 1) & ~((size_t) WORLD_ALIGN - 1);
+}
+
+/* Returns the checksum of a block of data: FNV-1a applied to 8 byte words (and then to any trailing bytes),
+   which keeps verifying large world files cheap. */
+uint64_t Checksum(const unsigned char* data, size_t size)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    uint64_t word;
+    size_t i;
+
+    for (i = 0; i + 8 <= size; i += 8)
+    {
+        memcpy(&word, data + i, 8);
+        hash ^= word;
+        hash *= 1099511628211ULL;
+    }
+    for (; i < size; i++)
+    {
+        hash ^= data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/* Flushes the entries of a directory to disk, so that files created or renamed into it stay there after a power
+   loss. */
+void SyncDir(char* dirName)
+{
+    int fd;
+    if ((fd = open(dirName, O_RDONLY | O_DIRECTORY)) == -1 || fsync(fd) != 0)
+    {
+        printf("ERROR: Failed to flush directory \"%s\"\n", dirName);
+        perror("In SyncDir()");
+        exit(1);
+    }
+    close(fd);
+}
+
+// Fills in the magic number, version, counts and section offsets of a header.
+static void LayOutWorldImage(struct WorldHeader* header, uint32_t numRooms, uint32_t numLinks, size_t poolSize)
+{
+    memset(header, 0, sizeof(struct WorldHeader));
+    memcpy(header->magic, WORLD_MAGIC, sizeof(header->magic));
+    header->version = WORLD_VERSION;
+    header->headerSize = AlignSize(sizeof(struct WorldHeader));
+    header->numRooms = numRooms;
+    header->numLinks = numLinks;
+    header->linkOffsetsOffset = header->headerSize;
+    header->linksOffset = AlignSize(header->linkOffsetsOffset + sizeof(uint32_t) * ((uint64_t) numRooms + 1));
+    header->typesOffset = AlignSize(header->linksOffset + sizeof(uint32_t) * (uint64_t) numLinks);
+    header->nameOffsetsOffset = AlignSize(header->typesOffset + (uint64_t) numRooms);
+    header->stringPoolOffset = AlignSize(header->nameOffsetsOffset + sizeof(uint32_t) * ((uint64_t) numRooms + 1));
+    header->stringPoolSize = poolSize;
+    header->fileSize = AlignSize(header->stringPoolOffset + poolSize);
+}
+
+// Points a world image at the sections of a block of data laid out by a header.
+static void PointAtSections(struct WorldImage* image, struct WorldHeader* header, unsigned char* data)
+{
+    image->numRooms = header->numRooms;
+    image->numLinks = header->numLinks;
+    image->linkOffsets = (uint32_t*) (data + header->linkOffsetsOffset);
+    image->links = (uint32_t*) (data + header->linksOffset);
+    image->types = data + header->typesOffset;
+    image->nameOffsets = (uint32_t*) (data + header->nameOffsetsOffset);
+    image->stringPool = (char*) (data + header->stringPoolOffset);
+    image->stringPoolSize = header->stringPoolSize;
+    image->data = data;
+    image->size = header->fileSize;
+}
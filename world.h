@@ -0,0 +1,111 @@
+/*************************************************************************************************************************
+ *
+ * NAME
+ *    world.h - the world representation shared by the room-building program and the game program
+ * SYNOPSIS
+ *    Declares the layout of a world image: the in-memory form of a world, which is also the exact content of the
+ *    binary world file (world.bin) that buildrooms writes and adventure maps.
+ * INSTRUCTIONS
+ *    Include this header and compile world.c along with the program, e.g.:
+ *       gcc -o adventure adventure.c world.c bench.c -lpthread
+ * DESCRIPTION
+ *    A world image is a header followed by five sections, each starting on an 8 byte boundary, ordered so that the
+ *       data touched on every move comes first:
+ *          > Connection offsets: numRooms+1 uint32_t, the connections of room i are links[offsets[i]..offsets[i+1]).
+ *          > Links: numLinks uint32_t room indexes (compressed sparse row, CSR).
+ *          > Types: numRooms uint8_t enum Types values, one byte per room.
+ *          > Name offsets: numRooms+1 uint32_t, the name of room i is stringPool[offsets[i]..offsets[i+1]-1).
+ *          > String pool: the room names, back to back, each followed by a null character.
+ *    The layout only depends on the number of rooms, links and the size of the string pool, so a reader checks the
+ *       offsets in the header against the ones it computes itself. Everything after the header is covered by a
+ *       checksum.
+ * AUTHOR
+ *    Written by Andrew Swaim
+ *
+*************************************************************************************************************************/
+
+#ifndef WORLD_H
+#define WORLD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define WORLD_FILENAME "world.bin"  // Name of the binary world file inside a rooms directory.
+#define WORLD_MAGIC "ADVWORLD"      // Identifies a binary world file (8 characters, no null character stored).
+#define WORLD_VERSION 2             // Bumped whenever the binary layout changes.
+#define WORLD_ALIGN 8               // Every section of the binary world file starts on this boundary.
+#define LATEST_LINK "rooms.latest"  // Symbolic link to the newest world, kept up to date by buildrooms.
+#define POOL_DIRNAME "pool"         // Directory of ready worlds kept full by buildrooms -P, claimed by adventure -P.
+#define CLAIMED_PREFIX "claimed."   // A pool world claimed by a game is renamed to claimed.PID (the game's process id).
+
+// Create bool type for C89/C90 compilation.
+typedef enum { false, true } bool;
+
+// Room type enum and string array for conversion.
+enum Types { START_ROOM, MID_ROOM, END_ROOM };
+extern char* types[];
+
+// Header of a world image, all offsets are in bytes from the start of the image.
+struct WorldHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t numRooms;
+    uint32_t numLinks;              // Total number of outbound connections (twice the number of corridors).
+    uint32_t startRoom;
+    uint32_t endRoom;
+    uint64_t linkOffsetsOffset;
+    uint64_t linksOffset;
+    uint64_t typesOffset;
+    uint64_t nameOffsetsOffset;
+    uint64_t stringPoolOffset;
+    uint64_t stringPoolSize;
+    uint64_t fileSize;
+    uint64_t checksum;              // Checksum() of every byte after the header.
+};
+
+// WorldImage struct, a world image and pointers to its sections.
+struct WorldImage
+{
+    uint32_t numRooms;
+    uint32_t numLinks;
+    uint32_t startRoom;
+    uint32_t endRoom;
+    uint32_t* linkOffsets;
+    uint32_t* links;
+    uint8_t* types;
+    uint32_t* nameOffsets;
+    char* stringPool;
+    size_t stringPoolSize;
+    unsigned char* data;            // The whole image, header included.
+    size_t size;
+};
+
+/*************************************************************************************************************************
+ * Function Declarations
+*************************************************************************************************************************/
+
+size_t GetWorldImageSize(uint32_t numRooms, uint32_t numLinks, size_t poolSize);
+void InitWorldImage(struct WorldImage* image, unsigned char* data, uint32_t numRooms, uint32_t numLinks,
+                    size_t poolSize);
+void SealWorldImage(struct WorldImage* image);
+char* AttachWorldImage(struct WorldImage* image, unsigned char* data, size_t size);
+void AttachSealedWorldImage(struct WorldImage* image, unsigned char* data);
+size_t AlignSize(size_t size);
+uint64_t Checksum(const unsigned char* data, size_t size);
+void SyncDir(char* dirName);
+
+// Returns the null-terminated name of a room.
+static inline const char* GetRoomName(const struct WorldImage* image, uint32_t room)
+{
+    return image->stringPool + image->nameOffsets[room];
+}
+
+// Returns the length of the name of a room, without the null character.
+static inline uint32_t GetNameLength(const struct WorldImage* image, uint32_t room)
+{
+    return image->nameOffsets[room+1] - image->nameOffsets[room] - 1;
+}
+
+#endif